@@ -6,8 +6,13 @@ namespace CZ
     class XDGKit;
     class XDGIconThemeManager;
     class XDGIconTheme;
+    class XDGIconQuery;
+    class XDGIconManifest;
+    class XDGIconHandle;
+    class XDGIconFuture;
     class XDGIconDirectory;
     class XDGIcon;
+    class XDGSizeBatch;
     class XDGINI;
     class XDGINIView;
 };
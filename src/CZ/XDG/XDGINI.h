@@ -9,8 +9,9 @@
 /**
  * @brief A parsed INI file.
  *
- * The content is organized in nested unordered maps. The top-level map represents
- * the sections, while the nested maps hold the key-value pairs within each section.
+ * Publicly inherits from XDGMap: the top-level map represents the sections, while the nested
+ * maps hold the key-value pairs within each section. Note that, unlike std::unordered_map,
+ * `value_type` has a non-const key, which must not be modified through iterators.
  *
  * All values are stored as strings.
  *
@@ -43,8 +44,8 @@ private:
 /**
  * @brief A parsed INI file using string view based maps.
  *
- * The content is organized in nested unordered maps. The top-level map represents
- * the sections, while the nested maps hold the key-value pairs within each section.
+ * Publicly inherits from XDGMap: the top-level map represents the sections, while the nested
+ * maps hold the key-value pairs within each section. As in XDGINI, `value_type` has a non-const key.
  *
  * Unlike XDGINI, this class provides a memory view of data stored in a serialized format.
  */
@@ -1,26 +1,94 @@
 #include <CZ/XDG/XDGKit.h>
 #include <CZ/XDG/XDGIcon.h>
 #include <CZ/XDG/XDGIconDirectory.h>
+#include <CZ/XDG/XDGIconTheme.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 
 using namespace CZ;
 
+static_assert(sizeof(XDGIcon) == 16);
+
+std::string_view XDGIcon::name() const noexcept
+{
+    return { m_directory->m_names + m_name, m_nameSize };
+}
+
 std::filesystem::path XDGIcon::getPath(Extension ext) const noexcept
 {
-    std::filesystem::path path = m_directory.dir() / m_name;
-    switch (ext)
+    char buffer[PATH_MAX];
+
+    if (writePath(ext, buffer) != 0)
+        return std::filesystem::path(buffer);
+
+    std::filesystem::path path { std::filesystem::path(m_directory->path()) / name() };
+    path += ExtensionSuffix(ext);
+    return path;
+}
+
+size_t XDGIcon::pathLength() const noexcept
+{
+    // Directory + '/' + name + ".ext"
+    return m_directory->path().size() + 1 + m_nameSize + 4;
+}
+
+size_t XDGIcon::writePath(Extension ext, std::span<char> buffer) const noexcept
+{
+    const std::string_view suffix { ExtensionSuffix(ext) };
+    const size_t length { pathLength() };
+
+    if (suffix.empty() || buffer.size() <= length)
+        return 0;
+
+    char *pos { buffer.data() };
+    std::memcpy(pos, m_directory->path().data(), m_directory->path().size());
+    pos += m_directory->path().size();
+    *pos++ = '/';
+    std::memcpy(pos, name().data(), m_nameSize);
+    pos += m_nameSize;
+    std::memcpy(pos, suffix.data(), suffix.size());
+    pos += suffix.size();
+    *pos = '\0';
+    return length;
+}
+
+int XDGIcon::open(Extension ext, int flags) const noexcept
+{
+    const std::string_view suffix { ExtensionSuffix(ext) };
+    char buffer[PATH_MAX];
+
+    if (suffix.empty())
     {
-    case PNG:
-        path += ".png";
-        break;
-    case SVG:
-        path += ".svg";
-        break;
-    case XPM:
-        path += ".xpm";
-        break;
+        errno = EINVAL;
+        return -1;
     }
 
-    return path;
+    if (m_nameSize + suffix.size() < sizeof(buffer))
+    {
+        std::memcpy(buffer, name().data(), m_nameSize);
+        std::memcpy(buffer + m_nameSize, suffix.data(), suffix.size() + 1);
+
+        const int dirFd { m_directory->theme().directoryFd(*m_directory) };
+
+        if (dirFd != -1)
+        {
+            const int fd { openat(dirFd, buffer, flags | O_CLOEXEC) };
+
+            // The directory may have been replaced since it was opened, retry with the full path
+            if (fd != -1 || errno != ENOENT)
+                return fd;
+        }
+    }
+
+    if (writePath(ext, buffer) == 0)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    return ::open(buffer, flags | O_CLOEXEC);
 }
 
 bool XDGIcon::usingCache() const noexcept
@@ -30,5 +98,5 @@ bool XDGIcon::usingCache() const noexcept
 
 XDGKit &XDGIcon::kit() const noexcept
 {
-    return m_directory.kit();
+    return m_directory->kit();
 }
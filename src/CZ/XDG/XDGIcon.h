@@ -3,6 +3,8 @@
 
 #include <CZ/XDG/XDG.h>
 #include <filesystem>
+#include <span>
+#include <string_view>
 
 /**
  * @brief Properties of an icon.
@@ -10,6 +12,9 @@
  * This class provides information about an icon, including its name, file extensions,
  * paths, and the directory to which it belongs.
  *
+ * Icons are compact 16 byte records stored contiguously in their directory (see XDGIconDirectory::icons()),
+ * the name is kept once per theme and referenced by offset.
+ *
  * @note Most of the icon properties can be found in its respective directory()
  */
 class CZ::XDGIcon
@@ -23,10 +28,42 @@ public:
     {
         PNG = static_cast<uint32_t>(1) << 0, /**< PNG file format. */
         SVG = static_cast<uint32_t>(1) << 1, /**< SVG file format. */
-        XPM = static_cast<uint32_t>(1) << 2  /**< XPM file format. */
+        XPM = static_cast<uint32_t>(1) << 2, /**< XPM file format. */
+
+        /**
+         * Not a file format, set for symbolic icons (names ending in "-symbolic").
+         *
+         * Symbolic icons are monochrome and meant to be recolored to match the foreground color.
+         */
+        Symbolic = static_cast<uint32_t>(1) << 3
     };
 
-    XDGIcon(XDGIconDirectory &directory) noexcept : m_directory(directory) {}
+    /**
+     * @brief Suffix of symbolic icon names.
+     */
+    static constexpr std::string_view SymbolicSuffix { "-symbolic" };
+
+    /**
+     * @brief File name suffix of an extension, e.g. ".png" for PNG.
+     *
+     * @return The suffix, or an empty string if `ext` is not a single file format.
+     */
+    static constexpr std::string_view ExtensionSuffix(Extension ext) noexcept
+    {
+        switch (ext)
+        {
+        case PNG:
+            return ".png";
+        case SVG:
+            return ".svg";
+        case XPM:
+            return ".xpm";
+        default:
+            return {};
+        }
+    }
+
+    XDGIcon(XDGIconDirectory &directory) noexcept : m_directory(&directory) {}
 
     /**
      * @brief Handle to the parent kit.
@@ -42,12 +79,19 @@ public:
      */
     uint32_t extensions() const noexcept { return m_extensions; };
 
+    /**
+     * @brief Checks whether this is a symbolic icon.
+     *
+     * Equivalent to checking the XDGIcon::Symbolic flag of extensions().
+     */
+    bool symbolic() const noexcept { return (m_extensions & Symbolic) != 0; };
+
     /**
      * @brief Retrieves the name of the icon.
      *
-     * @return A constant reference to the icon's name.
+     * @return The icon's name, null-terminated and valid as long as the icon.
      */
-    const std::string_view &name() const noexcept { return m_name; };
+    std::string_view name() const noexcept;
 
     /**
      * @brief Retrieves the absolute path of the icon for a specified file extension.
@@ -59,6 +103,36 @@ public:
      */
     std::filesystem::path getPath(Extension ext) const noexcept;
 
+    /**
+     * @brief Length of the absolute path of the icon file, excluding the null terminator.
+     *
+     * Same for all extensions.
+     */
+    size_t pathLength() const noexcept;
+
+    /**
+     * @brief Writes the absolute path of the icon for a specified file extension into a buffer.
+     *
+     * Unlike getPath(), no allocations are performed. The path is null-terminated.
+     *
+     * @param ext The file extension (PNG, SVG or XPM).
+     * @param buffer The destination buffer, must be able to hold `pathLength() + 1` bytes.
+     * @return The length of the path written (excluding the null terminator), or 0 if the buffer is too small or the extension is invalid.
+     */
+    size_t writePath(Extension ext, std::span<char> buffer) const noexcept;
+
+    /**
+     * @brief Opens the icon file for a specified file extension.
+     *
+     * The file is opened with `openat()` relative to a cached `O_PATH` descriptor of its directory,
+     * sparing the kernel from walking the full path each time. See XDGIconTheme::MaxDirectoryFds.
+     *
+     * @param ext The file extension (PNG, SVG or XPM).
+     * @param flags Flags passed to `openat()`, `O_CLOEXEC` is always added.
+     * @return A file descriptor owned by the caller, or -1 on failure (with `errno` set).
+     */
+    int open(Extension ext, int flags = 0) const noexcept;
+
     /**
      * @brief Retrieves the directory to which this icon belongs.
      *
@@ -66,7 +140,7 @@ public:
      *
      * @return A reference to the XDGIconDirectory object representing the directory.
      */
-    XDGIconDirectory &directory() const noexcept { return m_directory; };
+    XDGIconDirectory &directory() const noexcept { return *m_directory; };
 
     /**
      * @brief Indicates whether the parent theme was loaded from cache.
@@ -76,9 +150,12 @@ public:
 private:
     friend class XDGIconDirectory;
     friend class XDGIconTheme;
-    uint32_t m_extensions { 0 };
-    std::string_view m_name;
-    XDGIconDirectory &m_directory;
+    XDGIconDirectory *m_directory;
+
+    // Offset of the name in XDGIconDirectory::m_names
+    uint32_t m_name { 0 };
+    uint16_t m_nameSize { 0 };
+    uint8_t m_extensions { 0 };
 };
 
 #endif // XDGICON_H
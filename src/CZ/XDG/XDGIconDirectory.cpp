@@ -1,13 +1,16 @@
 #include <CZ/XDG/XDGIconDirectory.h>
 #include <CZ/XDG/XDGIcon.h>
 #include <CZ/XDG/XDGKit.h>
-#include <unordered_set>
+#include <CZ/XDG/XDGUtils.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
 
 using namespace CZ;
 
 std::filesystem::path XDGIconDirectory::dir() const noexcept
 {
-    return std::filesystem::path(m_themeDir) / m_dirName;
+    return std::filesystem::path(m_path);
 }
 
 bool XDGIconDirectory::usingCache() const noexcept
@@ -20,39 +23,131 @@ XDGKit &XDGIconDirectory::kit() const noexcept
     return m_theme.kit();
 }
 
+static uint64_t hashName(std::string_view name) noexcept
+{
+    // fmix64, as XDGMap
+    uint64_t h { static_cast<uint64_t>(std::hash<std::string_view>{}(name)) };
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
 void XDGIconDirectory::initIcons() noexcept
 {
     if (usingCache())
         return;
 
+    // Before listing, so files added meanwhile are detected by reloadThemes()
+    m_mtime = XDGUtils::modificationTime(m_path.data());
+
     try
     {
-        static const std::unordered_set<std::string> extensions( {".png", ".svg", ".xpm"} );
-
         for (const auto &entry : std::filesystem::directory_iterator(dir()))
         {
-            if (!std::filesystem::is_regular_file(entry.path()) || !extensions.contains(entry.path().extension()))
+            if (!entry.is_regular_file())
                 continue;
 
-            std::string_view name { kit().saveOrGetString(entry.path().stem().string()) };
+            const std::string &fileName { entry.path().native() };
+            const size_t nameStart { fileName.rfind('/') + 1 };
 
-            auto it = m_icons.find(name);
+            if (fileName.size() < nameStart + 5)
+                continue;
+
+            const std::string_view ext { std::string_view(fileName).substr(fileName.size() - 4) };
+            uint8_t extension;
 
-            if (it == m_icons.end())
+            if (ext == ".png")
+                extension = XDGIcon::PNG;
+            else if (ext == ".svg")
             {
-                it = m_icons.emplace(name, *this).first;
-                it->second.m_name = it->first;
+                extension = XDGIcon::SVG;
+                m_hasSvg = true;
             }
-
-            if (entry.path().extension() == ".png")
-                it->second.m_extensions |= XDGIcon::PNG;
-            else if (entry.path().extension() == ".svg")
-                it->second.m_extensions |= XDGIcon::SVG;
+            else if (ext == ".xpm")
+                extension = XDGIcon::XPM;
             else
-                it->second.m_extensions |= XDGIcon::XPM;
+                continue;
+
+            const std::string_view name { std::string_view(fileName).substr(nameStart, fileName.size() - nameStart - 4) };
+            auto &icon { m_icons.emplace_back(*this) };
+            icon.m_name = m_theme.saveOrGetIconName(name);
+            icon.m_nameSize = name.size();
+            icon.m_extensions = extension;
+
+            if (name.ends_with(XDGIcon::SymbolicSuffix))
+                icon.m_extensions |= XDGIcon::Symbolic;
 
             // TODO: Load .icon info
         }
     }
     catch (const std::exception &) {}
+
+    // Files of the same icon (e.g. .png and .svg) are merged, names are stored once so offsets are compared
+    std::sort(m_icons.begin(), m_icons.end(), [](const XDGIcon &a, const XDGIcon &b) { return a.m_name < b.m_name; });
+    size_t count { 0 };
+
+    for (size_t i = 0; i < m_icons.size(); i++)
+    {
+        if (count > 0 && m_icons[count - 1].m_name == m_icons[i].m_name)
+            m_icons[count - 1].m_extensions |= m_icons[i].m_extensions;
+        else
+            m_icons[count++] = m_icons[i];
+    }
+
+    m_icons.erase(m_icons.begin() + count, m_icons.end());
+}
+
+void XDGIconDirectory::initIconIndex() noexcept
+{
+    if (m_icons.size() > MaxIcons)
+        m_icons.erase(m_icons.begin() + MaxIcons, m_icons.end());
+
+    m_icons.shrink_to_fit();
+    m_iconIndex.clear();
+
+    if (m_icons.empty())
+    {
+        m_iconIndex.shrink_to_fit();
+        return;
+    }
+
+    // At most 3/4 full, misses end after a few probes and most are rejected by the tag
+    m_iconIndex.resize(std::bit_ceil(m_icons.size() + m_icons.size() / 3 + 1));
+    m_iconIndex.shrink_to_fit();
+    const size_t mask { m_iconIndex.size() - 1 };
+
+    for (uint32_t i = 0; i < m_icons.size(); i++)
+    {
+        const uint64_t hash { hashName(m_icons[i].name()) };
+        size_t pos { hash & mask };
+
+        while (m_iconIndex[pos] != 0)
+            pos = (pos + 1) & mask;
+
+        m_iconIndex[pos] = static_cast<uint32_t>(hash >> 56) << 24 | (i + 1);
+    }
+}
+
+const XDGIcon *XDGIconDirectory::findIcon(std::string_view name) const noexcept
+{
+    if (m_iconIndex.empty())
+        return nullptr;
+
+    const uint64_t hash { hashName(name) };
+    const uint32_t tag { static_cast<uint32_t>(hash >> 56) };
+    const size_t mask { m_iconIndex.size() - 1 };
+
+    for (size_t pos = hash & mask; m_iconIndex[pos] != 0; pos = (pos + 1) & mask)
+    {
+        if (m_iconIndex[pos] >> 24 != tag)
+            continue;
+
+        const XDGIcon &icon { m_icons[(m_iconIndex[pos] & 0xFFFFFF) - 1] };
+
+        if (icon.m_nameSize == name.size() && std::memcmp(m_names + icon.m_name, name.data(), name.size()) == 0)
+            return &icon;
+    }
+
+    return nullptr;
 }
@@ -4,7 +4,9 @@
 #include <CZ/XDG/XDGIcon.h>
 #include <CZ/XDG/XDGMap.h>
 #include <cstdint>
+#include <ctime>
 #include <filesystem>
+#include <vector>
 
 /**
  * @brief Group of icons with shared properties.
@@ -123,12 +125,46 @@ public:
      */
     std::filesystem::path dir() const noexcept;
 
+    /**
+     * @brief Retrieves the absolute path to the icon directory without allocating.
+     *
+     * The path is precomposed when the theme is loaded (or read from the cache) and is null-terminated.
+     */
+    const std::string_view &path() const noexcept { return m_path; };
+
+    /**
+     * @brief Lightweight view of the icons of a directory.
+     *
+     * Icons are stored contiguously and looked up by name through a compact hash index of 32 bit entries.
+     */
+    class Icons
+    {
+    public:
+        const XDGIcon *begin() const noexcept { return m_dir->m_icons.data(); }
+        const XDGIcon *end() const noexcept { return m_dir->m_icons.data() + m_dir->m_icons.size(); }
+        size_t size() const noexcept { return m_dir->m_icons.size(); }
+        bool empty() const noexcept { return m_dir->m_icons.empty(); }
+        const XDGIcon &operator[](size_t i) const noexcept { return m_dir->m_icons[i]; }
+
+        /**
+         * @brief Finds an icon by name.
+         *
+         * @return The icon or `nullptr` if not found.
+         */
+        const XDGIcon *find(std::string_view name) const noexcept { return m_dir->findIcon(name); }
+
+    private:
+        friend class XDGIconDirectory;
+        explicit Icons(const XDGIconDirectory *dir) noexcept : m_dir(dir) {}
+        const XDGIconDirectory *m_dir;
+    };
+
     /**
      * @brief Retrieves the icons located in the directory.
      *
-     * @return A constant reference to a map of icon names to their corresponding icon objects.
+     * @return A view of the icons, in no particular order.
      */
-    const XDGMap<std::string_view, XDGIcon> &icons() const noexcept { return m_icons; }
+    Icons icons() const noexcept { return Icons(this); }
 
     /**
      * @brief Retrieves the theme to which this directory belongs.
@@ -161,10 +197,36 @@ public:
 private:
     friend class XDGIconThemeManager;
     friend class XDGIconTheme;
+    friend class XDGIcon;
     void initIcons() noexcept;
-    XDGMap<std::string_view, XDGIcon> m_icons;
+    void initIconIndex() noexcept;
+    const XDGIcon *findIcon(std::string_view name) const noexcept;
+    std::vector<XDGIcon> m_icons;
+
+    // Open addressing table, each entry is an 8 bit hash tag followed by the icon index + 1 (0 if empty)
+    std::vector<uint32_t> m_iconIndex;
+    static constexpr uint32_t MaxIcons { (1 << 24) - 2 };
+
+    // Null-terminated icon names, the theme names or the mapped cache (see XDGIcon::m_name)
+    const char *m_names { nullptr };
+
+    // Position in the search order (scaled directories first)
+    uint32_t m_order { 0 };
+
+    // Index in XDGIconTheme::sizeClasses()
+    uint32_t m_sizeClass { 0 };
+
+    // At least one icon has an SVG file
+    bool m_hasSvg { false };
     std::string_view m_themeDir;
     std::string_view m_dirName;
+    std::string_view m_path;
+
+    // Cached O_PATH fd, see XDGIconTheme::directoryFd()
+    int m_fd { -1 };
+
+    // Modification time when the icons were listed, see XDGIconTheme::sourcesChanged()
+    timespec m_mtime {};
 
     // Equal to m_notCache or to the mapped cache
     Cache *m_cachePtr;
@@ -0,0 +1,110 @@
+#ifndef XDGICONFUTURE_H
+#define XDGICONFUTURE_H
+
+#include <CZ/XDG/XDG.h>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Result of `XDGIconThemeManager::findIconAsync()`.
+ *
+ * Resolved on the thread performing the lookups, either immediately if all the searched themes are loaded,
+ * or from `XDGIconThemeManager::dispatchLoaded()` once the background loader finishes loading them (themes trimmed
+ * in the meantime are loaded again). If the background loader is unavailable, it's resolved immediately with the
+ * icon found in the loaded themes.
+ *
+ * It can be polled, given a callback or awaited from a C++20 coroutine:
+ *
+ * @code
+ * Task loadIcon(XDGIconThemeManager &manager)
+ * {
+ *     const XDGIcon *icon { co_await manager.findIconAsync("firefox", 64) };
+ *     ...
+ * }
+ * @endcode
+ *
+ * @note The coroutine is resumed from `dispatchLoaded()`, so `loaderFd()` must be part of the event loop.
+ *       Futures still pending when the `XDGKit` instance is destroyed are never resolved.
+ */
+class CZ::XDGIconFuture
+{
+public:
+
+    /**
+     * @brief Creates an invalid future, resolved to `nullptr`.
+     */
+    XDGIconFuture() noexcept = default;
+
+    /**
+     * @brief Checks whether the future was returned by `XDGIconThemeManager::findIconAsync()`.
+     */
+    bool valid() const noexcept { return m_state != nullptr; }
+
+    /**
+     * @brief Checks whether the lookup has completed (always `true` for invalid futures).
+     */
+    bool ready() const noexcept { return !m_state || m_state->ready; }
+
+    /**
+     * @brief Retrieves the icon found, `nullptr` if not found or not ready().
+     */
+    const XDGIcon *get() const noexcept { return m_state && m_state->ready ? m_state->icon : nullptr; }
+
+    /**
+     * @brief Sets a callback invoked when the lookup completes, replacing the previous one.
+     *
+     * Invoked immediately if already ready().
+     */
+    void then(std::function<void(const XDGIcon*)> callback) noexcept
+    {
+        if (ready())
+            callback(get());
+        else
+            m_state->callback = std::move(callback);
+    }
+
+    /**
+     * @brief Coroutine support, only one coroutine can await the future.
+     */
+    bool await_ready() const noexcept { return ready(); }
+
+    /**
+     * @brief Coroutine support.
+     */
+    void await_suspend(std::coroutine_handle<> handle) const noexcept { m_state->waiter = handle; }
+
+    /**
+     * @brief Coroutine support.
+     */
+    const XDGIcon *await_resume() const noexcept { return get(); }
+
+private:
+    friend class XDGIconThemeManager;
+
+    // Shared with the manager until resolved
+    struct State
+    {
+        const XDGIcon *icon { nullptr };
+        bool ready { false };
+        std::function<void(const XDGIcon*)> callback;
+        std::coroutine_handle<> waiter;
+
+        void resolve(const XDGIcon *result) noexcept
+        {
+            icon = result;
+            ready = true;
+
+            if (callback)
+                std::exchange(callback, nullptr)(icon);
+
+            if (waiter)
+                std::exchange(waiter, nullptr).resume();
+        }
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+#endif // XDGICONFUTURE_H
@@ -0,0 +1,60 @@
+#ifndef XDGICONHANDLE_H
+#define XDGICONHANDLE_H
+
+#include <CZ/XDG/XDG.h>
+#include <cstdint>
+#include <limits>
+
+/**
+ * @brief Compact reference to an icon that can be kept across theme reloads.
+ *
+ * Unlike `const XDGIcon *` pointers, handles don't dangle when `XDGIconThemeManager::reloadThemes()` is called.
+ * A handle stores the indices of the icon's theme, directory and icon along with the generation of the theme,
+ * so resolving it while the theme is unchanged is O(1).
+ *
+ * After the theme is reloaded, `XDGIconThemeManager::resolve()` looks up the same icon name in the directory
+ * with the same name and updates the handle, or invalidates it if the icon no longer exists.
+ *
+ * @code
+ * XDGIconHandle handle { manager.makeHandle(manager.findIcon("firefox", 64)) };
+ *
+ * // Later, even after reloadThemes()
+ * if (const XDGIcon *icon = manager.resolve(handle))
+ *     draw(icon);
+ * @endcode
+ */
+class CZ::XDGIconHandle
+{
+public:
+
+    /**
+     * @brief Creates an invalid handle.
+     */
+    XDGIconHandle() noexcept = default;
+
+    /**
+     * @brief Checks whether the handle refers to an icon.
+     *
+     * A valid handle may still need to be re-resolved, see `XDGIconThemeManager::isCurrent()`.
+     */
+    bool valid() const noexcept { return m_theme != Invalid; }
+
+    /**
+     * @brief Checks whether the handle is valid.
+     */
+    explicit operator bool() const noexcept { return valid(); }
+
+    bool operator==(const XDGIconHandle &other) const noexcept = default;
+
+private:
+    friend class XDGIconThemeManager;
+    static constexpr uint32_t Invalid { std::numeric_limits<uint32_t>::max() };
+    uint32_t m_theme { Invalid };  // Theme slot, kept by name across reloads
+    uint32_t m_generation { 0 };   // Generation of the theme slot
+    uint32_t m_directory { 0 };    // Index of the directory in search order
+    uint32_t m_icon { 0 };         // Index of the icon in XDGIconDirectory::icons()
+    uint32_t m_name { 0 };         // Interned icon name
+    uint32_t m_dirName { 0 };      // Interned directory name
+};
+
+#endif // XDGICONHANDLE_H
@@ -0,0 +1,109 @@
+#include <CZ/XDG/XDGIconManifest.h>
+#include <CZ/XDG/XDGKit.h>
+#include <algorithm>
+
+using namespace CZ;
+
+XDGIconManifest::XDGIconManifest(XDGIconThemeManager &manager, std::span<const std::string_view> themes, uint32_t extensions, uint32_t contexts) noexcept :
+    m_query(manager, themes, extensions, contexts),
+    m_manager(&manager)
+{
+    manager.m_manifests.emplace_back(this);
+}
+
+XDGIconManifest::XDGIconManifest(XDGIconThemeManager &manager, const std::vector<std::string> &themes, uint32_t extensions, uint32_t contexts) noexcept :
+    m_query(manager, themes, extensions, contexts),
+    m_manager(&manager)
+{
+    manager.m_manifests.emplace_back(this);
+}
+
+XDGIconManifest::~XDGIconManifest() noexcept
+{
+    if (m_manager)
+        std::erase(m_manager->m_manifests, this);
+}
+
+uint32_t XDGIconManifest::add(std::string_view icon, int32_t size, int32_t scale) noexcept
+{
+    auto &entry { m_entries.emplace_back() };
+    entry.icon = icon;
+    entry.size = size;
+    entry.scale = scale;
+
+    if (m_manager)
+        assign(entry, m_query.find(entry.icon, size, scale));
+
+    return m_entries.size() - 1;
+}
+
+void XDGIconManifest::clear() noexcept
+{
+    m_entries.clear();
+    m_changed.clear();
+}
+
+const XDGIcon *XDGIconManifest::icon(uint32_t entry) noexcept
+{
+    if (!m_manager || entry >= m_entries.size())
+        return nullptr;
+
+    return m_manager->resolve(m_entries[entry].result);
+}
+
+void XDGIconManifest::clearChanged() noexcept
+{
+    for (uint32_t entry : m_changed)
+        m_entries[entry].changed = false;
+
+    m_changed.clear();
+}
+
+bool XDGIconManifest::assign(Entry &entry, const XDGIcon *icon) noexcept
+{
+    entry.result = m_query.manager().makeHandle(icon);
+
+    if (!icon)
+    {
+        const bool changed { !entry.path.empty() };
+        entry.path.clear();
+        entry.extensions = 0;
+        return changed;
+    }
+
+    const std::string_view dir { icon->directory().path() };
+    const std::string_view name { icon->name() };
+
+    if (entry.extensions == icon->extensions() && entry.path.size() == dir.size() + 1 + name.size() &&
+        entry.path.starts_with(dir) && entry.path.ends_with(name))
+        return false;
+
+    entry.path.assign(dir);
+    entry.path += '/';
+    entry.path += name;
+    entry.extensions = icon->extensions();
+    return true;
+}
+
+bool XDGIconManifest::update() noexcept
+{
+    bool changed { false };
+
+    for (uint32_t i = 0; i < m_entries.size(); i++)
+    {
+        Entry &entry { m_entries[i] };
+
+        if (!assign(entry, m_query.find(entry.icon, entry.size, entry.scale)))
+            continue;
+
+        changed = true;
+
+        if (!entry.changed)
+        {
+            entry.changed = true;
+            m_changed.emplace_back(i);
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,148 @@
+#ifndef XDGICONMANIFEST_H
+#define XDGICONMANIFEST_H
+
+#include <CZ/XDG/XDGIconQuery.h>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Set of icon lookups whose results are tracked across theme reloads.
+ *
+ * Each entry is an icon name, size and scale resolved with the themes, extensions and contexts of the manifest
+ * (see XDGIconQuery). When `XDGIconThemeManager::reloadThemes()` adds, replaces or removes themes, the entries are
+ * resolved again and those whose best result is now a different file, or has different extensions, are listed
+ * in changed(). Clients can then update only the affected icons instead of all of them.
+ *
+ * @code
+ * XDGIconManifest manifest { kit->iconThemeManager(), { "Adwaita", "" } };
+ * const uint32_t firefox { manifest.add("firefox", 64, 2) };
+ *
+ * manifest.setChangedCallback([&manifest]{
+ *     for (uint32_t entry : manifest.changed())
+ *         upload(manifest.icon(entry));
+ *
+ *     manifest.clearChanged();
+ * });
+ * @endcode
+ *
+ * @note If the XDGKit is destroyed first, the manifest is detached: icon() returns `nullptr`, add() no longer
+ *       resolves entries and query() must not be used. It can still be destroyed safely.
+ */
+class CZ::XDGIconManifest
+{
+public:
+
+    /**
+     * @brief Creates an empty manifest and registers it in the manager.
+     *
+     * @param manager The manager used to resolve the entries.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     */
+    XDGIconManifest(XDGIconThemeManager &manager,
+                    std::span<const std::string_view> themes = XDGIconThemeManager::AnyTheme,
+                    uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+                    uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Creates an empty manifest from a vector of theme names.
+     */
+    XDGIconManifest(XDGIconThemeManager &manager,
+                    const std::vector<std::string> &themes,
+                    uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+                    uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    XDGIconManifest(const XDGIconManifest &) = delete;
+    XDGIconManifest &operator=(const XDGIconManifest &) = delete;
+
+    /**
+     * @brief Unregisters the manifest from the manager, unless detached.
+     */
+    ~XDGIconManifest() noexcept;
+
+    /**
+     * @brief Adds a lookup and resolves it.
+     *
+     * @param icon The name of the icon to search for.
+     * @param size The desired nominal size of the icon.
+     * @param scale The scale factor of the icon.
+     * @return The index of the entry, used by icon() and listed in changed().
+     */
+    uint32_t add(std::string_view icon, int32_t size, int32_t scale = 1) noexcept;
+
+    /**
+     * @brief Removes all entries, along with the changed() list.
+     */
+    void clear() noexcept;
+
+    /**
+     * @brief Number of entries.
+     */
+    size_t size() const noexcept { return m_entries.size(); }
+
+    /**
+     * @brief Current result of an entry.
+     *
+     * @return The icon or `nullptr` if it wasn't found or the index is out of range.
+     */
+    const XDGIcon *icon(uint32_t entry) noexcept;
+
+    /**
+     * @brief Entries whose result changed since the last clearChanged(), without duplicates.
+     */
+    const std::vector<uint32_t> &changed() const noexcept { return m_changed; }
+
+    /**
+     * @brief Clears the changed() list.
+     */
+    void clearChanged() noexcept;
+
+    /**
+     * @brief Sets a function called after a reload changes the result of at least one entry.
+     *
+     * The callback is invoked from `XDGIconThemeManager::reloadThemes()`, which may also be called by
+     * lookups when `XDGKit::Options::autoReloadCache` is enabled.
+     */
+    void setChangedCallback(std::function<void()> callback) noexcept { m_callback = std::move(callback); }
+
+    /**
+     * @brief Query used to resolve the entries.
+     */
+    XDGIconQuery &query() noexcept { return m_query; }
+
+private:
+    friend class XDGIconThemeManager;
+
+    struct Entry
+    {
+        std::string icon;
+        int32_t size;
+        int32_t scale;
+        XDGIconHandle result;
+
+        // Identifies the file regardless of the theme generation: directory path / icon name
+        std::string path;
+        uint32_t extensions { 0 };
+        bool changed { false };
+    };
+
+    // Returns true if the result differs from the stored one
+    bool assign(Entry &entry, const XDGIcon *icon) noexcept;
+
+    // Resolves all entries again after a reload, returns true if any changed
+    bool update() noexcept;
+    XDGIconQuery m_query;
+
+    // Set to nullptr by the manager if destroyed first
+    XDGIconThemeManager *m_manager;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_changed;
+    std::function<void()> m_callback;
+};
+
+#endif // XDGICONMANIFEST_H
@@ -0,0 +1,79 @@
+#include <CZ/XDG/XDGIconQuery.h>
+#include <CZ/XDG/XDGKit.h>
+
+using namespace CZ;
+
+XDGIconQuery::XDGIconQuery(XDGIconThemeManager &manager, std::span<const std::string_view> themes, uint32_t extensions, uint32_t contexts) noexcept :
+    m_manager(manager),
+    m_themes(themes.begin(), themes.end()),
+    m_extensions(extensions),
+    m_contexts(contexts)
+{
+    update();
+}
+
+XDGIconQuery::XDGIconQuery(XDGIconThemeManager &manager, const std::vector<std::string> &themes, uint32_t extensions, uint32_t contexts) noexcept :
+    m_manager(manager),
+    m_themes(themes),
+    m_extensions(extensions),
+    m_contexts(contexts)
+{
+    update();
+}
+
+bool XDGIconQuery::valid() const noexcept
+{
+    return (m_extensions & (XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM)) != 0 && (m_contexts & XDGIconDirectory::AnyContext) != 0;
+}
+
+void XDGIconQuery::update() noexcept
+{
+    if (m_built && m_generation == m_manager.generation())
+        return;
+
+    m_built = true;
+    m_generation = m_manager.generation();
+    m_manager.buildSearchOrder(m_themes, m_searchOrder);
+}
+
+const std::vector<XDGIconTheme*> &XDGIconQuery::searchOrder() noexcept
+{
+    update();
+    return m_searchOrder;
+}
+
+const XDGIcon *XDGIconQuery::find(std::string_view icon, int32_t size, int32_t scale) noexcept
+{
+    if (m_manager.kit().options().useIconThemesCache && m_manager.kit().options().autoReloadCache)
+        m_manager.reloadThemes(true);
+
+    m_manager.maybeTrimMemory();
+
+    if (scale <= 0 || !valid())
+        return nullptr;
+
+    update();
+
+    XDGIconThemeManager::Search search
+    {
+        .icon = icon,
+        .size = size,
+        .scale = scale,
+        .bufferSize = size * scale,
+        .extensions = m_extensions,
+        .contexts = m_contexts,
+        .serial = ++m_manager.m_searchSerial
+    };
+
+    const XDGIcon *found;
+
+    for (XDGIconTheme *theme : m_searchOrder)
+    {
+        // Only marks the theme as recently used, the search order has no duplicates
+        theme->m_searchSerial = search.serial;
+        found = m_manager.findIconInTheme(search, *theme);
+        if (found) return found;
+    }
+
+    return search.bestIcon;
+}
@@ -0,0 +1,102 @@
+#ifndef XDGICONQUERY_H
+#define XDGICONQUERY_H
+
+#include <CZ/XDG/XDGIconThemeManager.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Prepared icon query.
+ *
+ * Stores a theme list along with extension and context filters, and resolves them once into the
+ * full theme search order (requested themes followed by their inherited themes, without duplicates).
+ *
+ * Each call to find() only requires the icon name, size and scale, avoiding the per-lookup theme
+ * list expansion performed by `XDGIconThemeManager::findIcon()`. The search order is rebuilt automatically
+ * after the themes are reloaded.
+ *
+ * @code
+ * XDGIconQuery query { kit->iconThemeManager(), { "Adwaita", "" } };
+ * const XDGIcon *icon { query.find("firefox", 64, 2) };
+ * @endcode
+ */
+class CZ::XDGIconQuery
+{
+public:
+
+    /**
+     * @brief Creates a prepared query.
+     *
+     * @param manager The manager used to resolve the themes.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     */
+    XDGIconQuery(XDGIconThemeManager &manager,
+                 std::span<const std::string_view> themes = XDGIconThemeManager::AnyTheme,
+                 uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+                 uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Creates a prepared query from a vector of theme names.
+     */
+    XDGIconQuery(XDGIconThemeManager &manager,
+                 const std::vector<std::string> &themes,
+                 uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+                 uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon.
+     *
+     * Equivalent to `XDGIconThemeManager::findIcon()` with the themes, extensions and contexts of this query.
+     *
+     * @param icon The name of the icon to search for.
+     * @param size The desired nominal size of the icon.
+     * @param scale The scale factor of the icon.
+     * @return A pointer to the closest matching icon, or `nullptr` if no match is found.
+     */
+    const XDGIcon *find(std::string_view icon, int32_t size, int32_t scale = 1) noexcept;
+
+    /**
+     * @brief Themes in the order they are searched.
+     *
+     * Includes inherited themes. Rebuilt if the themes were reloaded since the last call.
+     */
+    const std::vector<XDGIconTheme*> &searchOrder() noexcept;
+
+    /**
+     * @brief Handle to the theme manager.
+     */
+    XDGIconThemeManager &manager() const noexcept { return m_manager; }
+
+    /**
+     * @brief Theme names this query was created with.
+     */
+    const std::vector<std::string> &themes() const noexcept { return m_themes; }
+
+    /**
+     * @brief Acceptable image file extensions.
+     */
+    uint32_t extensions() const noexcept { return m_extensions; }
+
+    /**
+     * @brief Contexts the search is limited to.
+     */
+    uint32_t contexts() const noexcept { return m_contexts; }
+
+private:
+    bool valid() const noexcept;
+    void update() noexcept;
+    XDGIconThemeManager &m_manager;
+    std::vector<std::string> m_themes;
+    std::vector<XDGIconTheme*> m_searchOrder;
+    uint64_t m_generation { 0 };
+    uint32_t m_extensions;
+    uint32_t m_contexts;
+    bool m_built { false };
+};
+
+#endif // XDGICONQUERY_H
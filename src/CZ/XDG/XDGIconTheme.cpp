@@ -3,8 +3,15 @@
 #include <CZ/XDG/XDGKit.h>
 #include <CZ/XDG/XDGIconTheme.h>
 #include <CZ/XDG/XDGIconDirectory.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <unordered_map>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace CZ;
 
@@ -12,6 +19,8 @@ XDGIconTheme::XDGIconTheme(XDGKit &kit) noexcept : m_kit(kit) {}
 
 XDGIconTheme::~XDGIconTheme()
 {
+    closeDirectoryFds();
+
     if (m_cacheMap)
     {
         munmap(m_cacheMap, m_cacheMapSize);
@@ -29,19 +38,435 @@ XDGIconTheme::~XDGIconTheme()
 void XDGIconTheme::evictCache() noexcept
 {
     if (usingCache())
+    {
         madvise(m_cacheMap, m_cacheMapSize, MADV_DONTNEED);
+        m_cacheCold = true;
+        m_coldSerial = m_searchSerial;
+    }
+}
+
+bool XDGIconTheme::unload(bool pageOut) noexcept
+{
+    if (usingCache())
+    {
+        if (!m_cacheMap || m_cacheCold)
+            return false;
+
+        // MADV_COLD pages are reclaimed first under memory pressure, MADV_PAGEOUT reclaims them now
+        int ret { -1 };
+#ifdef MADV_PAGEOUT
+        if (pageOut)
+            ret = madvise(m_cacheMap, m_cacheMapSize, MADV_PAGEOUT);
+#endif
+#ifdef MADV_COLD
+        if (ret != 0)
+            ret = madvise(m_cacheMap, m_cacheMapSize, MADV_COLD);
+#endif
+        if (ret != 0)
+            madvise(m_cacheMap, m_cacheMapSize, MADV_DONTNEED);
+
+        m_cacheCold = true;
+        m_coldSerial = m_searchSerial;
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock { m_loadMutex };
+
+    if (!m_initialized.load(std::memory_order_acquire))
+        return false;
+
+    // Rebuilt by initAllIconsDir() from m_iconDirNames and m_scaledIconDirNames (or the index.theme in compact mode)
+    closeDirectoryFds();
+    m_index = {};
+    m_sizeClasses.clear();
+    std::fill_n(m_contextSizeClasses, 5, 0);
+    m_availability = {};
+    m_bufferSizes = {};
+    m_bufferSizesBuilt = false;
+    m_iconDirectories.clear();
+    m_scaledIconDirectories.clear();
+    m_stringPool = {};
+    m_iconNames = {};
+    m_memoryUsage = 0;
+    m_loadScheduled = false;
+    m_initialized.store(false, std::memory_order_release);
+    return true;
+}
+
+template <class Map>
+static size_t mapMemory(const Map &map) noexcept
+{
+    // Slots plus one control byte per slot
+    return map.capacity() * (sizeof(*map.begin()) + 1);
+}
+
+void XDGIconTheme::updateMemoryUsage() const noexcept
+{
+    // List and hash set nodes are estimated as two pointers
+    constexpr size_t node { 2 * sizeof(void*) };
+    size_t usage { mapMemory(m_availability) };
+
+    usage += m_index.entries.capacity() * sizeof(DirectoryIndexEntry);
+    usage += (m_index.directories.capacity() + m_index.svgDirs.capacity()) * sizeof(void*);
+
+    for (const auto &sizeClass : m_sizeClasses)
+        usage += sizeof(sizeClass) + sizeClass.directories.capacity() * sizeof(void*);
+
+    for (const auto *dirs : { &m_iconDirectories, &m_scaledIconDirectories })
+        for (const auto &dir : *dirs)
+            usage += node + sizeof(dir) + dir.m_icons.capacity() * sizeof(XDGIcon) + dir.m_iconIndex.capacity() * sizeof(uint32_t) +
+                (dir.m_ramCache ? sizeof(XDGIconDirectory::Cache) + node : 0);
+
+    for (const auto &str : m_stringPool)
+        usage += node + sizeof(str) + str.capacity();
+
+    usage += m_iconNames.capacity();
+
+    m_memoryUsage = usage;
+}
+
+void XDGIconTheme::closeDirectoryFds() noexcept
+{
+    for (auto *dir : m_dirFds)
+    {
+        close(dir->m_fd);
+        dir->m_fd = -1;
+    }
+
+    m_dirFds.clear();
+    m_dirFdsNext = 0;
+}
+
+int XDGIconTheme::directoryFd(XDGIconDirectory &dir) noexcept
+{
+    if (dir.m_fd != -1)
+        return dir.m_fd;
+
+    const int fd { open(dir.path().data(), O_PATH | O_DIRECTORY | O_CLOEXEC) };
+
+    if (fd == -1)
+        return -1;
+
+    if (m_dirFds.size() < MaxDirectoryFds)
+        m_dirFds.emplace_back(&dir);
+    else
+    {
+        auto *&evicted { m_dirFds[m_dirFdsNext] };
+        close(evicted->m_fd);
+        evicted->m_fd = -1;
+        evicted = &dir;
+        m_dirFdsNext = (m_dirFdsNext + 1) % MaxDirectoryFds;
+    }
+
+    dir.m_fd = fd;
+    return fd;
 }
 
 void XDGIconTheme::initAllIconsDir() const noexcept
 {
-    m_initialized = true;
+    std::lock_guard<std::mutex> lock { m_loadMutex };
+
+    // Loaded by another thread while waiting
+    if (m_initialized.load(std::memory_order_acquire))
+        return;
+
+    // Subdirectories added later are detected by sourcesChanged()
+    m_dirMtimes.clear();
+
+    for (const auto &dir : m_dirs)
+        m_dirMtimes.emplace_back(XDGUtils::modificationTime(dir.c_str()));
+
+    // Released by freeIndexData() in compact mode, see XDGKit::Options::compactThemes
+    if (m_indexData.empty())
+        reloadIndexData();
+
+    // Directory names are kept in case the theme is unloaded, see unload()
     initIconsDir(m_iconDirNames, XDGIconDirectory::Type::Normal);
     initIconsDir(m_scaledIconDirNames, XDGIconDirectory::Type::Scaled);
-    m_iconDirNames.clear();
-    m_scaledIconDirNames.clear();
-    m_iconDirNames.shrink_to_fit();
-    m_scaledIconDirNames.shrink_to_fit();
+
+    // Names are final now, icons can be hashed
+    m_iconNameIds = {};
+    m_iconNames.shrink_to_fit();
+
+    for (auto *dirs : { &m_iconDirectories, &m_scaledIconDirectories })
+    {
+        for (auto &dir : *dirs)
+        {
+            dir.m_names = m_iconNames.data();
+            dir.initIconIndex();
+        }
+    }
+
     m_dirs.shrink_to_fit();
+    initIndex({});
+    initSizeClasses();
+    initAvailability();
+    // Before publishing, the theme may be used as soon as it's initialized (see the background loader)
+    if (kit().options().compactThemes)
+        releaseIndexData();
+
+    updateMemoryUsage();
+    m_initialized.store(true, std::memory_order_release);
+}
+
+void XDGIconTheme::compactInfo() noexcept
+{
+    // Views into m_info, in the same order
+    std::string_view *fields[] { &m_displayName, &m_comment, &m_example, &m_inheritsValue };
+    size_t size { 0 };
+
+    for (const auto *field : fields)
+        size += field->size() + 1;
+
+    m_info.clear();
+    m_info.reserve(size);
+
+    for (const auto *field : fields)
+    {
+        m_info.append(*field);
+        m_info.push_back('\0');
+    }
+
+    size = 0;
+
+    for (auto *field : fields)
+    {
+        *field = std::string_view(m_info.data() + size, field->size());
+        size += field->size() + 1;
+    }
+}
+
+void XDGIconTheme::reloadIndexData() const noexcept
+{
+    m_indexData = std::move(*XDGINIView::LoadFile(m_indexFilePath).get());
+
+    const auto &mainSection { m_indexData.find("Icon Theme") };
+
+    // Changed on disk, the theme is replaced on the next reloadThemes() (see sourcesChanged())
+    if (mainSection == m_indexData.end())
+    {
+        XDGLog(CZWarning, CZLN, "Failed to read the index of theme {} again: {}", m_name, m_indexFilePath.c_str());
+        return;
+    }
+
+    const auto &directories { mainSection->second.find("Directories") };
+    const auto &scaledDirectories { mainSection->second.find("ScaledDirectories") };
+
+    if (directories != mainSection->second.end())
+        m_iconDirNames = XDGUtils::splitString(directories->second, ',', true);
+
+    if (scaledDirectories != mainSection->second.end())
+        m_scaledIconDirNames = XDGUtils::splitString(scaledDirectories->second, ',', true);
+}
+
+static uint32_t contextBucket(XDGIconDirectory::Context context) noexcept
+{
+    // Invalid contexts (0) go after all buckets
+    return std::countr_zero(static_cast<uint32_t>(context));
+}
+
+bool XDGIconTheme::DirectoryIndexLess(const XDGIconDirectory &a, const XDGIconDirectory &b) noexcept
+{
+    const uint32_t ctxA { contextBucket(a.context()) }, ctxB { contextBucket(b.context()) };
+
+    if (ctxA != ctxB)
+        return ctxA < ctxB;
+
+    if (a.scale() != b.scale())
+        return a.scale() < b.scale();
+
+    if (a.size() != b.size())
+        return a.size() < b.size();
+
+    return a.m_order < b.m_order;
+}
+
+void XDGIconTheme::initIndex(std::vector<const XDGIconDirectory *> &&sorted) const noexcept
+{
+    // Search order
+    uint32_t order { 0 };
+
+    for (auto *dirs : { &m_scaledIconDirectories, &m_iconDirectories })
+    {
+        for (auto &dir : *dirs)
+        {
+            dir.m_order = order++;
+            m_index.directories.emplace_back(&dir);
+
+            if (dir.m_hasSvg)
+                m_index.svgDirs.emplace_back(&dir);
+        }
+    }
+
+    // Already sorted when loaded from cache (unless the file was tampered with)
+    if (sorted.size() != order || !std::is_sorted(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return DirectoryIndexLess(*a, *b); }))
+    {
+        sorted.clear();
+        sorted.reserve(order);
+
+        for (const auto *dirs : { &m_scaledIconDirectories, &m_iconDirectories })
+            for (const auto &dir : *dirs)
+                sorted.emplace_back(&dir);
+
+        std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return DirectoryIndexLess(*a, *b); });
+    }
+
+    m_index.entries.reserve(sorted.size());
+    uint32_t bucket { 0 };
+
+    for (const auto *dir : sorted)
+    {
+        while (bucket < 5 && contextBucket(dir->context()) > bucket)
+            m_index.contextBegin[++bucket] = m_index.entries.size();
+
+        m_index.entries.emplace_back(dir->scale(), dir->size(), dir);
+    }
+
+    while (bucket < 5)
+        m_index.contextBegin[++bucket] = m_index.entries.size();
+}
+
+void XDGIconTheme::initBufferSizes() const noexcept
+{
+    m_bufferSizesBuilt = true;
+    auto &table { m_bufferSizes.byMin };
+    table.reserve(scaledIconDirectories().size() + iconDirectories().size());
+
+    // Same order as findIcon(), kept among equal ranges by stable_sort
+    for (const auto *dirs : { &scaledIconDirectories(), &iconDirectories() })
+    {
+        for (const auto &dir : *dirs)
+        {
+            const auto &d { *dir.data() };
+
+            if (d.sizeType == XDGIconDirectory::Fixed)
+                table.emplace_back(d.size * d.scale, d.size * d.scale, &dir);
+            else if (d.sizeType == XDGIconDirectory::Scalable)
+                table.emplace_back(d.minSize * d.scale, d.maxSize * d.scale, &dir);
+            else if (d.sizeType == XDGIconDirectory::Threshold)
+                table.emplace_back((d.size - d.threshold) * d.scale, (d.maxSize + d.threshold) * d.scale, &dir);
+        }
+    }
+
+    m_bufferSizes.byMax = table;
+    std::stable_sort(table.begin(), table.end(), [](const auto &a, const auto &b) { return a.min < b.min; });
+    std::stable_sort(m_bufferSizes.byMax.begin(), m_bufferSizes.byMax.end(), [](const auto &a, const auto &b) { return a.max < b.max; });
+}
+
+void XDGIconTheme::initSizeClasses() const noexcept
+{
+    // Directories with equal context, scale and size are adjacent in the index
+    size_t groupBegin { 0 };
+
+    for (const auto &entry : m_index.entries)
+    {
+        const auto &d { *entry.dir->data() };
+
+        if (!m_sizeClasses.empty())
+        {
+            const auto &g { m_sizeClasses[groupBegin].geometry };
+
+            if (g.context != d.context || g.scale != d.scale || g.size != d.size)
+                groupBegin = m_sizeClasses.size();
+        }
+
+        size_t i { groupBegin };
+
+        for (; i < m_sizeClasses.size(); i++)
+        {
+            const auto &g { m_sizeClasses[i].geometry };
+
+            if (g.sizeType == d.sizeType && g.minSize == d.minSize && g.maxSize == d.maxSize && g.threshold == d.threshold)
+                break;
+        }
+
+        if (i == m_sizeClasses.size())
+        {
+            m_sizeClasses.emplace_back(d);
+
+            const uint32_t bucket { static_cast<uint32_t>(std::countr_zero(static_cast<uint32_t>(d.context))) };
+
+            if (i < MaxSizeClasses && bucket < 5)
+                m_contextSizeClasses[bucket] |= uint64_t(1) << i;
+        }
+
+        m_sizeClasses[i].directories.emplace_back(entry.dir);
+        const_cast<XDGIconDirectory*>(entry.dir)->m_sizeClass = i;
+    }
+}
+
+void XDGIconTheme::initAvailability() const noexcept
+{
+    if (m_sizeClasses.size() > MaxSizeClasses)
+        return;
+
+    for (const auto &sizeClass : m_sizeClasses)
+    {
+        for (const auto *dir : sizeClass.directories)
+        {
+            const uint64_t bit { uint64_t(1) << dir->m_sizeClass };
+
+            for (const auto &icon : dir->icons())
+            {
+                auto &availability { m_availability[icon.name()] };
+
+                if (icon.extensions() & XDGIcon::PNG)
+                    availability.png |= bit;
+                if (icon.extensions() & XDGIcon::SVG)
+                    availability.svg |= bit;
+                if (icon.extensions() & XDGIcon::XPM)
+                    availability.xpm |= bit;
+            }
+        }
+    }
+}
+
+size_t XDGIconTheme::availableSizes(std::string_view icon, std::span<AvailableSize> sizes) const noexcept
+{
+    size_t count { 0 };
+
+    if (!iconAvailability().empty())
+    {
+        const auto &it { m_availability.find(icon) };
+
+        if (it == m_availability.end())
+            return 0;
+
+        for (uint64_t mask = it->second.mask(XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM); mask && count < sizes.size(); mask &= mask - 1)
+        {
+            const uint32_t i { static_cast<uint32_t>(std::countr_zero(mask)) };
+            const uint64_t bit { uint64_t(1) << i };
+            sizes[count++] =
+            {
+                .sizeClass = &m_sizeClasses[i],
+                .extensions = ((it->second.png & bit) ? XDGIcon::PNG : 0u) | ((it->second.svg & bit) ? XDGIcon::SVG : 0u) | ((it->second.xpm & bit) ? XDGIcon::XPM : 0u)
+            };
+        }
+
+        return count;
+    }
+
+    // Too many size classes to be tracked by bitmaps
+    for (const auto &sizeClass : m_sizeClasses)
+    {
+        uint32_t extensions { 0 };
+
+        for (const auto *dir : sizeClass.directories)
+        {
+            if (const XDGIcon *it { dir->icons().find(icon) })
+                extensions |= it->extensions() & (XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM);
+        }
+
+        if (extensions == 0)
+            continue;
+
+        if (count == sizes.size())
+            break;
+
+        sizes[count++] = { .sizeClass = &sizeClass, .extensions = extensions };
+    }
+
+    return count;
 }
 
 void XDGIconTheme::initIconsDir(const std::vector<std::string> &iconDirs, XDGIconDirectory::Type type) const noexcept
@@ -139,38 +564,262 @@ void XDGIconTheme::initIconsDir(const std::vector<std::string> &iconDirs, XDGIco
             if (std::filesystem::is_directory(themeDir / iconDir))
             {
                 auto &newIconDir = iconsDirVec->emplace_back(IcD);
-                newIconDir.m_themeDir = kit().saveOrGetString(themeDir.string());
-                newIconDir.m_dirName = kit().saveOrGetString(iconDir);
+                newIconDir.m_ramCache = std::make_shared<XDGIconDirectory::Cache>(*IcD.m_cachePtr);
+                newIconDir.m_cachePtr = newIconDir.m_ramCache.get();
+                newIconDir.m_themeDir = saveOrGetString(themeDir.string());
+                newIconDir.m_dirName = saveOrGetString(iconDir);
+                newIconDir.m_path = saveOrGetString((themeDir / iconDir).string());
                 newIconDir.initIcons();
             }
         }
     }
 }
 
+std::filesystem::path XDGIconTheme::cacheFilePath() const noexcept
+{
+    const bool isUser { m_indexFilePath.string().starts_with("/home") };
+
+    return isUser ?
+        std::filesystem::path("/var/cache/xdgkit/icon_themes/users") / kit().m_user / name() :
+        std::filesystem::path("/var/cache/xdgkit/icon_themes/system") / name();
+}
+
+bool XDGIconTheme::writeCache(const std::filesystem::path &path) const noexcept
+{
+    // Serialized index.theme, released in compact mode
+    if (!m_indexData.map())
+    {
+        XDGLog(CZWarning, CZLN, "Failed to write the cache of theme {}: the index.theme data was released", name());
+        return false;
+    }
+
+    uint64_t u64;
+    uint32_t u32;
+    bool boolean;
+    std::vector<const XDGIconDirectory*> dirs;
+    std::unordered_map<const XDGIconDirectory*, uint32_t> order;
+    std::string padding;
+    const uint64_t pageSize { (uint64_t)sysconf(_SC_PAGESIZE) };
+
+    try
+    {
+        std::ofstream file(path, std::ios::binary);
+
+        if (!file)
+        {
+            XDGLog(CZWarning, CZLN, "Failed to create the cache file {} of theme {}", path.string(), name());
+            return false;
+        }
+
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+        // Format
+        u32 = CacheMagic;
+        file.write((const char*)&u32, sizeof(u32));
+        u32 = CacheVersion;
+        file.write((const char*)&u32, sizeof(u32));
+
+        // Theme name
+        file.write(name().c_str(), name().size() + 1);
+
+        // Serialized index.theme size
+        u64 = m_indexData.mapSize();
+        file.write((const char*)&u64, sizeof(u64));
+
+        // Serialized index.theme data
+        file.write((const char*)m_indexData.map(), u64);
+
+        // Directories num
+        u64 = iconDirectories().size() + scaledIconDirectories().size();
+        file.write((const char*)&u64, sizeof(u64));
+
+        // Directories in index order (see DirectoryIndexLess())
+        for (const auto &dir : scaledIconDirectories())
+            dirs.emplace_back(&dir);
+
+        for (const auto &dir : iconDirectories())
+            dirs.emplace_back(&dir);
+
+        for (size_t i = 0; i < dirs.size(); i++)
+            order[dirs[i]] = i;
+
+        std::sort(dirs.begin(), dirs.end(), [](const auto *a, const auto *b) { return DirectoryIndexLess(*a, *b); });
+
+        // Directory table offset, page aligned so it can be read ahead on its own
+        u64 = (uint64_t)file.tellp() + sizeof(u64);
+        u64 = (u64 + pageSize - 1) / pageSize * pageSize;
+        file.write((const char*)&u64, sizeof(u64));
+        padding.assign(u64 - (uint64_t)file.tellp(), '\0');
+        file.write(padding.data(), padding.size());
+
+        // Directory table, cache data (size, minSize, etc)
+        for (const auto *dir : dirs)
+            file.write((const char*)dir->data(), sizeof(*dir->data()));
+
+        for (const auto *dir : dirs)
+        {
+            // Search order
+            u32 = order[dir];
+            file.write((const char*)&u32, sizeof(u32));
+
+            // Is Scaled
+            boolean = dir->type() == XDGIconDirectory::Scaled;
+            file.write((const char*)&boolean, sizeof(boolean));
+
+            // Theme dir
+            file.write((const char*)dir->themeDir().data(), dir->themeDir().size() + 1);
+
+            // Dir name
+            file.write((const char*)dir->dirName().data(), dir->dirName().size() + 1);
+
+            // Dir path
+            file.write((const char*)dir->path().data(), dir->path().size() + 1);
+
+            // Icons num
+            u64 = dir->icons().size();
+            file.write((const char*)&u64, sizeof(u64));
+
+            for (const auto &icon : dir->icons())
+            {
+                // Icon name
+                file.write((const char*)icon.name().data(), icon.name().size() + 1);
+
+                // Extensions
+                u32 = icon.extensions();
+                file.write((const char*)&u32, sizeof(u32));
+            }
+        }
+
+        // Icon availability
+        u64 = sizeClasses().size();
+        file.write((const char*)&u64, sizeof(u64));
+        u64 = iconAvailability().size();
+        file.write((const char*)&u64, sizeof(u64));
+
+        for (const auto &icon : iconAvailability())
+        {
+            // Icon name
+            file.write((const char*)icon.first.data(), icon.first.size() + 1);
+
+            // Size class masks
+            file.write((const char*)&icon.second, sizeof(icon.second));
+        }
+
+        file.close();
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        XDGLog(CZWarning, CZLN, "Failed to write the cache file {} of theme {}: {}", path.string(), name(), e.what());
+        return false;
+    }
+}
+
+bool XDGIconTheme::sourcesChanged(const std::vector<std::filesystem::path> &dirs, const std::filesystem::path &indexFilePath) noexcept
+{
+    // Serializes with initAllIconsDir() in the background loader
+    std::lock_guard<std::mutex> lock { m_loadMutex };
+
+    if (dirs != m_dirs || indexFilePath != m_indexFilePath)
+        return true;
+
+    if (kit().options().useIconThemesCache)
+    {
+        const std::filesystem::path cachePath { cacheFilePath() };
+        struct stat st;
+        const bool hasCache { stat(cachePath.c_str(), &st) == 0 };
+
+        if (hasCache != (m_cacheIno != 0))
+            return true;
+
+        if (hasCache && (st.st_ino != m_cacheIno || !XDGUtils::sameTime(st.st_mtim, m_cacheMtime)))
+        {
+            // The indexer rewrites all cache files, the mapping is kept if the content didn't change
+            if (!m_usingCache || !sameCacheContent(cachePath, st.st_size))
+                return true;
+
+            m_cacheIno = st.st_ino;
+            m_cacheMtime = st.st_mtim;
+        }
+
+        if (m_usingCache)
+            return false;
+    }
+
+    if (!XDGUtils::sameTime(XDGUtils::modificationTime(m_indexFilePath.c_str()), m_indexMtime))
+        return true;
+
+    // Directories are only listed once loaded
+    if (!m_initialized.load(std::memory_order_acquire))
+        return false;
+
+    for (size_t i = 0; i < m_dirs.size(); i++)
+        if (!XDGUtils::sameTime(XDGUtils::modificationTime(m_dirs[i].c_str()), m_dirMtimes[i]))
+            return true;
+
+    for (const auto *dirs : { &m_iconDirectories, &m_scaledIconDirectories })
+        for (const auto &dir : *dirs)
+            if (!XDGUtils::sameTime(XDGUtils::modificationTime(dir.path().data()), dir.m_mtime))
+                return true;
+
+    return false;
+}
+
+bool XDGIconTheme::sameCacheContent(const std::filesystem::path &path, off_t size) const noexcept
+{
+    if (!m_cacheMap || (uint64_t)size != m_cacheMapSize)
+        return false;
+
+    const int fd { open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+
+    if (fd == -1)
+        return false;
+
+    char buffer[16384];
+    uint64_t offset { 0 };
+    bool same { true };
+
+    while (same && offset < m_cacheMapSize)
+    {
+        const ssize_t len { pread(fd, buffer, std::min<uint64_t>(sizeof(buffer), m_cacheMapSize - offset), offset) };
+
+        if (len <= 0)
+            same = false;
+        else
+        {
+            same = memcmp(buffer, (const char*)m_cacheMap + offset, len) == 0;
+            offset += len;
+        }
+    }
+
+    close(fd);
+    return same;
+}
+
 void XDGIconTheme::loadCache() noexcept
 {
     if (!kit().options().useIconThemesCache)
         return;
 
-    const bool isUser { m_indexFilePath.string().starts_with("/home") };
-
-    std::filesystem::path cacheFilePath {
-        isUser ?
-        std::filesystem::path("/var/cache/xdgkit/icon_themes/users") / kit().username() / name() :
-        std::filesystem::path("/var/cache/xdgkit/icon_themes/system") / name()
-    };
+    const std::filesystem::path cacheFilePath { this->cacheFilePath() };
+    struct stat st;
     off_t off;
     uint64_t u64, numDirs, numIcons;
-    uint32_t u32;
-    char *pos, *end, *str, *themeDir, *dirName, *iconName;
+    uint32_t u32, nameSize;
+    char *pos, *end, *str, *themeDir, *dirName, *dirPath, *iconName;
     const char *error { "Unknown error." };
     bool boolean;
     std::list<XDGIconDirectory> *dirList;
     XDGIconDirectory::Cache *cache;
+    std::vector<const XDGIconDirectory*> sorted;
+    Availability availability;
 
-    if (!std::filesystem::exists(cacheFilePath))
+    if (stat(cacheFilePath.c_str(), &st) != 0)
         return;
 
+    // Compared by sourcesChanged(), even if loading fails
+    m_cacheIno = st.st_ino;
+    m_cacheMtime = st.st_mtim;
     m_usingCache = true;
     m_initialized = true;
     m_cacheFd = open(cacheFilePath.c_str(), O_RDONLY);
@@ -190,8 +839,16 @@ void XDGIconTheme::loadCache() noexcept
     }
     m_cacheMapSize = off;
 
+    // Icon names are referenced by 32 bit offsets, see XDGIcon
+    if (m_cacheMapSize > UINT32_MAX)
+    {
+        error = "Cache file too large.";
+        goto failFd;
+    }
+
     // Map file
-    m_cacheMap = mmap(nullptr, m_cacheMapSize, PROT_READ, MAP_SHARED, m_cacheFd, 0);
+    m_cacheMap = mmap(nullptr, m_cacheMapSize, PROT_READ,
+        MAP_SHARED | ((kit().options().cacheMapFlags & XDGKit::CacheMapPopulate) ? MAP_POPULATE : 0), m_cacheFd, 0);
     if (m_cacheMap == MAP_FAILED)
     {
         error = "Failed to map cache file.";
@@ -202,6 +859,19 @@ void XDGIconTheme::loadCache() noexcept
     pos = (char*)m_cacheMap;
     end = pos + m_cacheMapSize;
 
+    // Magic and version
+    if (!(pos = XDGUtils::readSafeAndAdvancePos(&u32, pos, end, sizeof(u32))) || u32 != CacheMagic)
+    {
+        error = "Invalid cache file.";
+        goto failParse;
+    }
+
+    if (!(pos = XDGUtils::readSafeAndAdvancePos(&u32, pos, end, sizeof(u32))) || u32 != CacheVersion)
+    {
+        error = "Unsupported cache file version, run cz-xdgkit-icon-theme-indexer to update it.";
+        goto failParse;
+    }
+
     // Validate the name match
     str = pos;
     if (!(pos = XDGUtils::advanceStrPosSafe(pos, end)))
@@ -280,20 +950,44 @@ void XDGIconTheme::loadCache() noexcept
         goto failParse;
     }
 
+    // Directory table (page aligned)
+    if (!(pos = XDGUtils::readSafeAndAdvancePos(&u64, pos, end, sizeof(u64))))
+    {
+        error = "Failed to get the directory table offset.";
+        goto failParse;
+    }
+
+    if (u64 < (uint64_t)(pos - (char*)m_cacheMap) || u64 > m_cacheMapSize || (m_cacheMapSize - u64) / sizeof(*cache) < numDirs)
+    {
+        error = "The directory table is out of bounds.";
+        goto failParse;
+    }
+
+    cache = (XDGIconDirectory::Cache*)((char*)m_cacheMap + u64);
+    pos = (char*)(cache + numDirs);
+
+    // Read ahead the directory table, touched by every lookup
+    if (kit().options().cacheMapFlags & XDGKit::CacheMapWillNeed)
+    {
+        const uint64_t pageMask { (uint64_t)sysconf(_SC_PAGESIZE) - 1 };
+        madvise((char*)m_cacheMap + (u64 & ~pageMask), (u64 & pageMask) + numDirs * sizeof(*cache), MADV_WILLNEED);
+    }
+
+    sorted.reserve(numDirs);
+
     for (uint64_t i = 0; i < numDirs; i++)
     {
-        // Is scaled
-        if (!(pos = XDGUtils::readSafeAndAdvancePos(&boolean, pos, end, sizeof(boolean))))
+        // Search order
+        if (!(pos = XDGUtils::readSafeAndAdvancePos(&u32, pos, end, sizeof(u32))))
         {
-            error = "Failed to get directory type.";
+            error = "Failed to get directory order.";
             goto failParse;
         }
 
-        // Dir cache
-        cache = (XDGIconDirectory::Cache*)pos;
-        if (!(pos = XDGUtils::advanceSafe(pos, end, sizeof(*cache))))
+        // Is scaled
+        if (!(pos = XDGUtils::readSafeAndAdvancePos(&boolean, pos, end, sizeof(boolean))))
         {
-            error = "Failed to get directory data.";
+            error = "Failed to get directory type.";
             goto failParse;
         }
 
@@ -313,16 +1007,27 @@ void XDGIconTheme::loadCache() noexcept
             goto failParse;
         }
 
+        // Dir path
+        dirPath = pos;
+        if (!(pos = XDGUtils::advanceStrPosSafe(pos, end)))
+        {
+            error = "Failed to get dir path.";
+            goto failParse;
+        }
+
         // Store pointers
         if (boolean)
-            dirList = &m_iconDirectories;
-        else
             dirList = &m_scaledIconDirectories;
+        else
+            dirList = &m_iconDirectories;
 
         auto &dir { dirList->emplace_back(*this) };
-        dir.m_cachePtr = cache;
+        sorted.emplace_back(&dir);
+        dir.m_order = u32;
+        dir.m_cachePtr = &cache[i];
         dir.m_dirName = dirName;
         dir.m_themeDir = themeDir;
+        dir.m_path = dirPath;
 
         // Icons num
         if (!(pos = XDGUtils::readSafeAndAdvancePos(&numIcons, pos, end, sizeof(numIcons))))
@@ -340,6 +1045,7 @@ void XDGIconTheme::loadCache() noexcept
                 error = "Failed to get icon name.";
                 goto failParse;
             }
+            nameSize = pos - iconName - 1;
 
             // Extensions
             if (!(pos = XDGUtils::readSafeAndAdvancePos(&u32, pos, end, sizeof(u32))))
@@ -348,15 +1054,81 @@ void XDGIconTheme::loadCache() noexcept
                 goto failParse;
             }
 
-            // Assign pointers
-            const auto &icon { dir.m_icons.emplace(iconName, dir) };
-            icon.first->second.m_name = iconName;
-            icon.first->second.m_extensions = u32;
+            // Names are referenced by their offset in the mapping
+            auto &icon { dir.m_icons.emplace_back(dir) };
+            icon.m_name = iconName - (char*)m_cacheMap;
+            icon.m_nameSize = nameSize;
+            icon.m_extensions = u32;
+
+            if (u32 & XDGIcon::SVG)
+                dir.m_hasSvg = true;
+        }
+
+        dir.m_names = (const char*)m_cacheMap;
+        dir.initIconIndex();
+    }
+
+    // Directories are stored in index order
+    m_scaledIconDirectories.sort([](const auto &a, const auto &b) { return a.m_order < b.m_order; });
+    m_iconDirectories.sort([](const auto &a, const auto &b) { return a.m_order < b.m_order; });
+    initIndex(std::move(sorted));
+    initSizeClasses();
+
+    // Icon availability, rebuilt if the size classes don't match
+    if (!(pos = XDGUtils::readSafeAndAdvancePos(&u64, pos, end, sizeof(u64))))
+    {
+        error = "Failed to get the number of size classes.";
+        goto failParse;
+    }
+
+    boolean = u64 == m_sizeClasses.size();
+
+    if (!(pos = XDGUtils::readSafeAndAdvancePos(&numIcons, pos, end, sizeof(numIcons))))
+    {
+        error = "Failed to get the number of icons.";
+        goto failParse;
+    }
+
+    if (boolean)
+        m_availability.reserve(numIcons);
+
+    for (uint64_t i = 0; i < numIcons; i++)
+    {
+        iconName = pos;
+        if (!(pos = XDGUtils::advanceStrPosSafe(pos, end)))
+        {
+            error = "Failed to get icon name.";
+            goto failParse;
         }
+
+        if (!(pos = XDGUtils::readSafeAndAdvancePos(&availability, pos, end, sizeof(availability))))
+        {
+            error = "Failed to get icon availability.";
+            goto failParse;
+        }
+
+        if (boolean)
+            m_availability.emplace(iconName, availability);
     }
 
+    if (!boolean)
+    {
+        m_availability.clear();
+        initAvailability();
+    }
+
+    // Once parsed, icon names are only touched by hash lookups, readahead would load unrelated pages
+    if (kit().options().cacheMapFlags & XDGKit::CacheMapRandom)
+        madvise(m_cacheMap, m_cacheMapSize, MADV_RANDOM);
+
+    updateMemoryUsage();
     return;
 failParse:
+    m_index = {};
+    m_sizeClasses.clear();
+    std::fill_n(m_contextSizeClasses, 5, 0);
+    m_availability.clear();
+    m_scaledIconDirectories.clear();
     m_iconDirectories.clear();
     m_indexData = {};
     munmap(m_cacheMap, m_cacheMapSize);
@@ -3,10 +3,15 @@
 
 #include <CZ/XDG/XDGIconDirectory.h>
 #include <CZ/XDG/XDGINI.h>
+#include <atomic>
 #include <filesystem>
 #include <list>
+#include <mutex>
+#include <span>
 #include <string>
+#include <unordered_set>
 #include <vector>
+#include <sys/stat.h>
 
 /**
  * @brief An icon theme.
@@ -23,6 +28,25 @@ public:
     XDGIconTheme(XDGKit &kit) noexcept;
     ~XDGIconTheme();
 
+    /**
+     * @brief Identifies icon theme cache files ("XDGI" in little endian).
+     */
+    static constexpr uint32_t CacheMagic { 0x49474458 };
+
+    /**
+     * @brief Version of the cache file format, caches with a different version are ignored.
+     */
+    static constexpr uint32_t CacheVersion { 4 };
+
+    /**
+     * @brief Order of the per-theme directory index.
+     *
+     * Directories are sorted by context, scale and size, falling back to the search order (scaled directories first).
+     * The index lets `XDGIconThemeManager::findIcon()` jump to the directories matching the requested size.
+     * Cache files store directories in this order so the index is loaded without sorting.
+     */
+    static bool DirectoryIndexLess(const XDGIconDirectory &a, const XDGIconDirectory &b) noexcept;
+
     /**
      * @brief Handle to the parent kit.
      */
@@ -35,7 +59,7 @@ public:
      * @brief Verifies whether the theme has been loaded.
      *
      * The theme is loaded lazily when either `iconDirectories()` or `scaledIconDirectories()`
-     * is accessed for the first time.
+     * is accessed for the first time, or in the background, see `XDGIconThemeManager::findIconNonBlocking()`.
      */
     bool initialized() const noexcept
     {
@@ -49,7 +73,7 @@ public:
      */
     const std::string &name() const noexcept
     {
-        return *m_name;
+        return m_name;
     }
 
     /**
@@ -131,6 +155,8 @@ public:
     /**
      * @brief Retrieves the parsed `index.theme` data.
      *
+     * @note Empty once the theme is initialized if `XDGKit::Options::compactThemes` is enabled.
+     *
      * @return A constant reference to the parsed data stored in an XDGINI object.
      */
     const XDGINIView &indexData() const noexcept
@@ -164,11 +190,108 @@ public:
         return m_scaledIconDirectories;
     }
 
+    /**
+     * @brief Group of directories sharing context, size, scale and size type.
+     */
+    struct SizeClass
+    {
+        /**
+         * @brief Properties shared by the directories (type is the one of the first directory).
+         */
+        XDGIconDirectory::Cache geometry;
+
+        /**
+         * @brief Directories of the class in search order.
+         */
+        std::vector<const XDGIconDirectory*> directories;
+    };
+
+    /**
+     * @brief Maximum number of size classes tracked by iconAvailability().
+     */
+    static constexpr size_t MaxSizeClasses { 64 };
+
+    /**
+     * @brief Size classes of the theme, sorted by context, scale and size.
+     */
+    const std::vector<SizeClass> &sizeClasses() const noexcept
+    {
+        if (!m_initialized)
+            initAllIconsDir();
+
+        return m_sizeClasses;
+    }
+
+    /**
+     * @brief Size classes in which an icon is available, per format.
+     *
+     * Bit `i` of each mask is set if at least one directory of the i-th size class contains the icon with that format.
+     */
+    struct Availability
+    {
+        uint64_t png { 0 }; /**< Size classes with a PNG file. */
+        uint64_t svg { 0 }; /**< Size classes with an SVG file. */
+        uint64_t xpm { 0 }; /**< Size classes with an XPM file. */
+
+        /**
+         * @brief Size classes with any of the given XDGIcon::Extension formats.
+         */
+        uint64_t mask(uint32_t extensions) const noexcept
+        {
+            return ((extensions & XDGIcon::PNG) ? png : 0) | ((extensions & XDGIcon::SVG) ? svg : 0) | ((extensions & XDGIcon::XPM) ? xpm : 0);
+        }
+    };
+
+    /**
+     * @brief Availability of each icon of the theme.
+     *
+     * Lets `XDGIconThemeManager::findIcon()` skip themes without the icon and pick the best size with a bit scan.
+     * Stored in the cache file when available.
+     *
+     * @note Empty if the theme has more than `MaxSizeClasses` size classes, icons are then selected using the directory index.
+     */
+    const XDGMap<std::string_view, Availability> &iconAvailability() const noexcept
+    {
+        if (!m_initialized)
+            initAllIconsDir();
+
+        return m_availability;
+    }
+
+    /**
+     * @brief Size class and formats available for an icon, see availableSizes().
+     */
+    struct AvailableSize
+    {
+        const SizeClass *sizeClass; /**< The size class. */
+        uint32_t extensions;        /**< XDGIcon::Extension flags available in the size class. */
+    };
+
+    /**
+     * @brief Lists the sizes in which an icon is available in this theme (excluding inherited themes).
+     *
+     * @param icon The name of the icon.
+     * @param sizes Buffer where the sizes are stored, sorted by context, scale and size.
+     * @return The number of sizes written to the buffer.
+     */
+    size_t availableSizes(std::string_view icon, std::span<AvailableSize> sizes) const noexcept;
+
     /**
      * @brief Indicates whether the theme was loaded from cache.
      */
     bool usingCache() const noexcept { return m_usingCache; }
 
+    /**
+     * @brief Writes the cache file of the theme.
+     *
+     * Used by `cz-xdgkit-icon-theme-indexer`, which stores the files in the directories read by XDGKit.
+     * The theme must have been loaded without cache and with `XDGKit::Options::compactThemes` disabled.
+     *
+     * @param path Path of the cache file, replaced if it exists.
+     * @return `true` on success, `false` otherwise.
+     */
+    bool writeCache(const std::filesystem::path &path) const noexcept;
+
     /**
      * @brief Suggests to the OS to evict the mapped cache file from memory.
      *
@@ -176,38 +299,209 @@ public:
      * helping to free up memory by prompting the OS to release the data.
      */
     void evictCache() noexcept;
+
+    /**
+     * @brief Estimated memory used by the loaded theme, in bytes.
+     *
+     * Includes directories, icon tables and strings, plus the size of the mapped cache file unless
+     * it was evicted and the theme hasn't been searched since. 0 if the theme isn't loaded.
+     */
+    size_t memoryUsage() const noexcept
+    {
+        if (!m_initialized.load(std::memory_order_acquire))
+            return 0;
+
+        return m_memoryUsage + (m_cacheMap && !m_cacheCold ? m_cacheMapSize : 0);
+    }
+
+    /**
+     * @brief Maximum number of directory file descriptors kept open by the theme, see XDGIcon::open().
+     */
+    static constexpr size_t MaxDirectoryFds { 32 };
+
+    /**
+     * @brief Closes the directory file descriptors cached by XDGIcon::open().
+     */
+    void closeDirectoryFds() noexcept;
 private:
     /**
-     * @brief Clears the contents of indexData().
+     * @brief Clears the contents of indexData() and the directory names.
      *
      * This method releases the information of the loaded `index.theme` when it is no longer needed.
-     * This doesn't affect properties such as name(), displayName(), comment(), ext.
+     * This doesn't affect properties such as name(), displayName(), comment(), etc., see compactInfo().
      *
      * @note Calling this method on an uninitialized theme has no effect.
      */
-    void freeIndexData() noexcept
+    void freeIndexData() const noexcept
     {
         if (m_initialized)
-            m_indexData.clear();
+            releaseIndexData();
+    }
+
+    // freeIndexData() without the initialized check, used before m_initialized is published
+    void releaseIndexData() const noexcept
+    {
+        m_indexData.clear();
+        m_iconDirNames = {};
+        m_scaledIconDirNames = {};
+    }
+
+    // Moves the fields still needed after freeIndexData() out of m_indexData
+    void compactInfo() noexcept;
+
+    // Parses the index.theme again after freeIndexData() so the directories can be rebuilt
+    void reloadIndexData() const noexcept;
+
+    // Directories bucketed by context and sorted by (scale, size, search order)
+    struct DirectoryIndexEntry
+    {
+        int32_t scale;
+        int32_t size;
+        const XDGIconDirectory *dir;
+    };
+
+    struct DirectoryIndex
+    {
+        std::vector<DirectoryIndexEntry> entries;
+
+        // All directories in search order (XDGIconDirectory::m_order)
+        std::vector<const XDGIconDirectory*> directories;
+
+        // entries[contextBegin[i], contextBegin[i + 1]) have the context 1 << i
+        uint32_t contextBegin[6] {};
+
+        // Directories with SVG icons in search order
+        std::vector<const XDGIconDirectory*> svgDirs;
+    };
+
+    const DirectoryIndex &index() const noexcept
+    {
+        if (!m_initialized)
+            initAllIconsDir();
+
+        return m_index;
+    }
+
+    // Range of buffer sizes (size * scale) covered by a directory, see bufferSizes()
+    struct BufferSizeRange
+    {
+        int32_t min;
+        int32_t max;
+        const XDGIconDirectory *dir;
+    };
+
+    // Directories sorted by min and by max buffer size, built on first use
+    struct BufferSizeTable
+    {
+        std::vector<BufferSizeRange> byMin;
+        std::vector<BufferSizeRange> byMax;
+    };
+
+    const BufferSizeTable &bufferSizes() const noexcept
+    {
+        if (!m_bufferSizesBuilt)
+            initBufferSizes();
+
+        return m_bufferSizes;
     }
 
     friend class XDGIconThemeManager;
+    friend class XDGIconDirectory;
+    friend class XDGIconQuery;
+    friend class XDGIcon;
+
+    // Strings of the directories and icons, per theme so it can be loaded from the background loader thread
+    std::string_view saveOrGetString(const std::string &string) const noexcept
+    {
+        return m_stringPool.insert(string).first->c_str();
+    }
+
+    // Offset of the null-terminated name in m_iconNames, each name is stored once while loading
+    uint32_t saveOrGetIconName(std::string_view name) const noexcept
+    {
+        const auto [it, inserted] { m_iconNameIds.try_emplace(name, m_iconNames.size()) };
+
+        if (inserted)
+        {
+            m_iconNames.append(name);
+            m_iconNames.push_back('\0');
+        }
+
+        return it->second;
+    }
+
+    // O_PATH fd of the directory, opened on demand and cached (up to MaxDirectoryFds), -1 on failure
+    int directoryFd(XDGIconDirectory &dir) noexcept;
+    void initBufferSizes() const noexcept;
+    void initIndex(std::vector<const XDGIconDirectory*> &&sorted) const noexcept;
+    void initSizeClasses() const noexcept;
+    void initAvailability() const noexcept;
     void initAllIconsDir() const noexcept;
+    void updateMemoryUsage() const noexcept;
+
+    // Evicts the cache mapping or, without cache, drops directories until used again (see XDGKit::Options::memoryBudget)
+    // pageOut reclaims the mapping immediately (MADV_PAGEOUT) instead of on pressure (MADV_COLD)
+    bool unload(bool pageOut = false) noexcept;
     void initIconsDir(const std::vector<std::string> &iconDirs, XDGIconDirectory::Type type) const noexcept;
     void loadCache() noexcept;
+    std::filesystem::path cacheFilePath() const noexcept;
+
+    // Whether the theme must be replaced by reloadThemes(), dirs and indexFilePath are the ones found now
+    bool sourcesChanged(const std::vector<std::filesystem::path> &dirs, const std::filesystem::path &indexFilePath) noexcept;
+    bool sameCacheContent(const std::filesystem::path &path, off_t size) const noexcept;
     mutable std::list<XDGIconDirectory> m_iconDirectories;
     mutable std::list<XDGIconDirectory> m_scaledIconDirectories;
-    const std::string *m_name;
+    std::string m_name;
     std::string_view m_displayName;
     std::string_view m_comment;
     std::string_view m_example;
+
+    // Raw Inherits value, split by XDGIconThemeManager::resolveInherits()
+    std::string_view m_inheritsValue;
+
+    // Display name, comment, example and inherits (null-separated) in compact mode, the views above point here
+    std::string m_info;
     mutable std::vector<std::string> m_inherits;
     mutable std::vector<std::filesystem::path> m_dirs;
     mutable std::filesystem::path m_indexFilePath;
     mutable XDGINIView m_indexData;
+
+    // Modification times of the sources, see sourcesChanged()
+    timespec m_indexMtime {};
+    mutable std::vector<timespec> m_dirMtimes;
+    timespec m_cacheMtime {};
+    ino_t m_cacheIno { 0 };
     mutable std::vector<std::string> m_iconDirNames, m_scaledIconDirNames;
     XDGKit &m_kit;
-    mutable bool m_initialized { false };
+    mutable DirectoryIndex m_index;
+    mutable std::vector<SizeClass> m_sizeClasses;
+    mutable uint64_t m_contextSizeClasses[5] {};
+    mutable XDGMap<std::string_view, Availability> m_availability;
+    mutable BufferSizeTable m_bufferSizes;
+    mutable std::unordered_set<std::string> m_stringPool;
+
+    // Icon names without cache, referenced by offset from XDGIcon (see XDGIconDirectory::m_names)
+    mutable std::string m_iconNames;
+    mutable XDGMap<std::string, uint32_t> m_iconNameIds;
+
+    // Set (release) once loaded, m_loadMutex serializes initAllIconsDir() between threads
+    mutable std::atomic<bool> m_initialized { false };
+    mutable std::mutex m_loadMutex;
+
+    // Queued in the background loader, only accessed from the manager thread
+    bool m_loadScheduled { false };
+
+    // See memoryUsage(), the mapping is cold until searched after m_coldSerial
+    mutable size_t m_memoryUsage { 0 };
+    uint64_t m_coldSerial { 0 };
+    bool m_cacheCold { false };
+    mutable bool m_bufferSizesBuilt { false };
+
+    // Directories with an open fd, replaced in FIFO order once full
+    std::vector<XDGIconDirectory*> m_dirFds;
+    size_t m_dirFdsNext { 0 };
+    uint64_t m_searchSerial { 0 };
+    uint32_t m_slot { 0 };
     bool m_hidden { false };
     bool m_usingCache { false };
     void *m_cacheMap { nullptr };
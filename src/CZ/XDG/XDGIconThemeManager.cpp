@@ -2,6 +2,15 @@
 #include <CZ/XDG/XDGIconThemeManager.h>
 #include <CZ/XDG/XDGKit.h>
 #include <CZ/XDG/XDGUtils.h>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 using namespace CZ;
 
@@ -9,17 +18,17 @@ void XDGIconThemeManager::restoreDefaultSearchDirs() noexcept
 {
     m_searchDirs = std::vector<std::filesystem::path>();
     m_searchDirs.reserve(32);
-    std::filesystem::path path = m_kit.homeDir() / ".icons";
+    std::filesystem::path path = m_kit.m_homeDir / ".icons";
 
     if (std::filesystem::is_directory(path))
         m_searchDirs.emplace_back(std::move(path));
 
-    path = m_kit.homeDir() / ".local/share/icons";
+    path = m_kit.m_homeDir / ".local/share/icons";
 
     if (std::filesystem::is_directory(path))
         m_searchDirs.emplace_back(std::move(path));
 
-    for (auto &dataDir : m_kit.dataDirs())
+    for (auto &dataDir : m_kit.m_dataDirs)
     {
         path = dataDir / "icons";
 
@@ -36,6 +45,37 @@ void XDGIconThemeManager::restoreDefaultSearchDirs() noexcept
 void XDGIconThemeManager::findThemes() noexcept
 {
     m_themes.clear();
+    m_missingThemes.clear();
+    m_allThemesFound = false;
+
+    // Only the allowlisted themes and their inheritance closure, others are found on demand
+    if (!kit().options().themes.empty())
+    {
+        loadTheme("hicolor");
+
+        for (const auto &theme : kit().options().themes)
+            loadTheme(theme);
+    }
+    else
+        findAllThemes();
+
+    assignThemeSlots();
+}
+
+void XDGIconThemeManager::findAllThemes() noexcept
+{
+    if (m_allThemesFound)
+        return;
+
+    m_allThemesFound = true;
+
+    // Everything was discovered by the init thread unless limited to the allowlist
+    if (mergeDiscoveredThemes() && kit().options().themes.empty())
+        return;
+
+    // Themes already loaded from the allowlist are kept as is
+    XDGMap<std::string, std::shared_ptr<XDGIconTheme>> found;
+    std::vector<XDGIconTheme*> added;
 
     try
     {
@@ -50,12 +90,17 @@ void XDGIconThemeManager::findThemes() noexcept
                 if (!themeDir.is_directory())
                     continue;
 
-                auto foundTheme = m_themes.find(themeDir.path().filename());
+                const std::string name { themeDir.path().filename() };
 
-                if (foundTheme == m_themes.end())
+                if (m_themes.find(name) != m_themes.end())
+                    continue;
+
+                auto foundTheme = found.find(name);
+
+                if (foundTheme == found.end())
                 {
-                    auto [it, inserted] = m_themes.emplace(themeDir.path().filename(), std::shared_ptr<XDGIconTheme>(new XDGIconTheme(m_kit)));
-                    it->second->m_name = &it->first;
+                    auto [it, inserted] = found.emplace(name, std::shared_ptr<XDGIconTheme>(new XDGIconTheme(m_kit)));
+                    it->second->m_name = it->first;
                     it->second->m_dirs.reserve(16);
                     it->second->m_dirs.emplace_back(themeDir.path());
 
@@ -79,305 +124,2050 @@ void XDGIconThemeManager::findThemes() noexcept
             }
         }
 
-        // Filter themes without index.theme
-        for (auto it = m_themes.begin(); it != m_themes.end();)
+        // Filter themes without a valid index.theme
+        for (auto &theme : found)
         {
-            if (it->second->m_indexFilePath.empty())
-                it = m_themes.erase(it);
-            else
+            if (initTheme(*theme.second))
             {
-                it->second->loadCache();
+                added.emplace_back(theme.second.get());
+                m_themes.emplace(theme.first, std::move(theme.second));
+            }
+        }
+    }
+    catch (const std::exception &){}
+
+    // Inherits is done once all themes are known
+    for (XDGIconTheme *theme : added)
+    {
+        resolveInherits(*theme);
+        assignThemeSlot(*theme);
+    }
+}
 
-                if (!it->second->m_usingCache)
-                    it->second->m_indexData = std::move(*XDGINIView::LoadFile(it->second->m_indexFilePath).get());
+XDGIconTheme *XDGIconThemeManager::loadTheme(std::string_view name) noexcept
+{
+    const auto &it { m_themes.find(name) };
 
-                const auto &mainSection { it->second->m_indexData.find("Icon Theme") };
+    if (it != m_themes.end())
+        return it->second.get();
 
-                if (mainSection == it->second->m_indexData.end())
-                {
-                    it = m_themes.erase(it);
-                    continue;
-                }
+    if (m_allThemesFound || m_missingThemes.find(name) != m_missingThemes.end())
+        return nullptr;
 
-                // Required fields
-                const auto &name { mainSection->second.find("Name") };
-                const auto &comment { mainSection->second.find("Comment") };
-                const auto &directories { mainSection->second.find("Directories") };
+    std::shared_ptr<XDGIconTheme> theme;
 
-                if (name == mainSection->second.end() || comment == mainSection->second.end() || directories == mainSection->second.end())
-                {
-                    it = m_themes.erase(it);
-                    continue;
-                }
+    // Parsed by the init thread, otherwise here
+    if (!takeDiscoveredTheme(name, theme))
+    {
+        theme.reset(new XDGIconTheme(m_kit));
+        theme->m_name = name;
+        findThemeDirs(name, theme->m_dirs, theme->m_indexFilePath);
 
-                it->second->m_displayName = name->second;
-                it->second->m_comment = comment->second;
+        if (!initTheme(*theme))
+            theme.reset();
+    }
 
-                it->second->m_iconDirNames = XDGUtils::splitString(directories->second, ',', true);
+    if (!theme)
+    {
+        m_missingThemes.emplace(name, true);
+        return nullptr;
+    }
 
-                const auto &scaledDirectories { mainSection->second.find("ScaledDirectories") };
-                const auto &hidden { mainSection->second.find("Hidden") };
-                const auto &example { mainSection->second.find("Example") };
+    m_themes.emplace(std::string(name), theme);
+    assignThemeSlot(*theme);
 
-                if (scaledDirectories != mainSection->second.end())
-                    it->second->m_scaledIconDirNames = XDGUtils::splitString(scaledDirectories->second, ',', true);
+    // Inherited themes are loaded recursively (the theme is already in m_themes, so cycles stop here)
+    // Loading them may rehash m_themes, only the theme itself is used afterwards
+    resolveInherits(*theme);
+    return theme.get();
+}
 
-                // Inherits is done later
+void XDGIconThemeManager::discoverThemes() noexcept
+{
+    std::vector<std::string> names;
 
-                if (hidden != mainSection->second.end())
-                    it->second->m_hidden = hidden->second == "true";
-                if (example != mainSection->second.end())
-                    it->second->m_example = example->second;
+    // Same themes findThemes() would load
+    if (!kit().options().themes.empty())
+    {
+        names.emplace_back("hicolor");
+        names.insert(names.end(), kit().options().themes.begin(), kit().options().themes.end());
+    }
+    else
+    {
+        try
+        {
+            for (auto &searchDir : searchDirs())
+            {
+                if (!std::filesystem::is_directory(searchDir))
+                    continue;
 
-                ++it;
+                for (const auto &themeDir : std::filesystem::directory_iterator(searchDir))
+                    if (themeDir.is_directory())
+                        names.emplace_back(themeDir.path().filename());
             }
         }
+        catch (const std::exception &) {}
+    }
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_discoveryMutex };
+
+            if (m_discoveryStop)
+                break;
+
+            // Found in multiple search dirs, or already taken by loadTheme()
+            if (!m_discovered.try_emplace(names[i]).second)
+                continue;
+        }
+
+        std::shared_ptr<XDGIconTheme> theme { new XDGIconTheme(m_kit) };
+        theme->m_name = names[i];
+        findThemeDirs(names[i], theme->m_dirs, theme->m_indexFilePath);
+
+        if (!initTheme(*theme))
+            theme.reset();
+        else if (!kit().options().themes.empty() && !theme->m_inheritsValue.empty())
+        {
+            // Inherited themes are part of the allowlist closure
+            for (auto &inherited : XDGUtils::splitString(theme->m_inheritsValue, ',', true))
+                names.emplace_back(std::move(inherited));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock { m_discoveryMutex };
+            auto &discovered { m_discovered.find(names[i])->second };
+            discovered.theme = std::move(theme);
+            discovered.done = true;
+        }
 
+        m_discoveryCond.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock { m_discoveryMutex };
+        m_discovering = false;
+    }
+
+    m_discoveryCond.notify_all();
+}
+
+bool XDGIconThemeManager::takeDiscoveredTheme(std::string_view name, std::shared_ptr<XDGIconTheme> &theme) noexcept
+{
+    if (!m_discoveryPending)
+        return false;
+
+    std::unique_lock<std::mutex> lock { m_discoveryMutex };
+    const auto &it { m_discovered.find(name) };
+
+    if (it == m_discovered.end())
+    {
+        // Parsed by the caller, the init thread skips it
+        m_discovered.try_emplace(std::string(name)).first->second.done = true;
+        return false;
     }
-    catch (const std::exception &){}
 
-    sanitizeThemes();
+    // Only waits if the init thread is parsing this one
+    m_discoveryCond.wait(lock, [this, name]{ return m_discovered.find(name)->second.done; });
+    theme = std::move(m_discovered.find(name)->second.theme);
+    return true;
 }
 
-void XDGIconThemeManager::sanitizeThemes() noexcept
+bool XDGIconThemeManager::mergeDiscoveredThemes() noexcept
 {
-    const auto &hicolor = m_themes.find("hicolor");
+    if (!m_discoveryPending)
+        return false;
+
+    m_discoveryPending = false;
+    XDGMap<std::string, DiscoveredTheme> discovered;
+
+    {
+        std::unique_lock<std::mutex> lock { m_discoveryMutex };
+        m_discoveryCond.wait(lock, [this]{ return !m_discovering; });
+        discovered.swap(m_discovered);
+    }
+
+    std::vector<XDGIconTheme*> added;
 
-    for (auto it = m_themes.begin(); it != m_themes.end(); it++)
+    for (auto &entry : discovered)
     {
-        if (hicolor == it)
+        if (!entry.second.theme || m_themes.find(entry.first) != m_themes.end())
             continue;
 
-        // Already verified that exists
-        const auto &mainSection { it->second->m_indexData.find("Icon Theme") };
-        const auto &inherits { mainSection->second.find("Inherits") };
+        added.emplace_back(entry.second.theme.get());
+        m_themes.emplace(entry.first, std::move(entry.second.theme));
+    }
+
+    for (XDGIconTheme *theme : added)
+    {
+        resolveInherits(*theme);
+        assignThemeSlot(*theme);
+    }
+
+    return true;
+}
+
+void XDGIconThemeManager::stopDiscovery() noexcept
+{
+    std::lock_guard<std::mutex> lock { m_discoveryMutex };
+    m_discoveryStop = true;
+}
+
+void XDGIconThemeManager::findThemeDirs(std::string_view name, std::vector<std::filesystem::path> &dirs, std::filesystem::path &indexFilePath) const noexcept
+{
+    dirs.clear();
+    indexFilePath.clear();
 
-        if (inherits != mainSection->second.end())
+    try
+    {
+        for (auto &searchDir : searchDirs())
         {
-            it->second->m_inherits = XDGUtils::splitString(inherits->second, ',', true);
-            if (hicolor != m_themes.end())
-                it->second->m_inherits.emplace_back("hicolor");
-            XDGUtils::removeDuplicates(it->second->m_inherits);
+            const std::filesystem::path themeDir { searchDir / name };
+
+            if (!std::filesystem::is_directory(themeDir))
+                continue;
+
+            dirs.emplace_back(themeDir);
 
-            // Remove self and non existent inherits
-            for (auto inh = it->second->m_inherits.begin(); inh != it->second->m_inherits.end();)
+            if (indexFilePath.empty())
             {
-                if (*inh == it->first || m_themes.find(*inh) == m_themes.end())
-                    inh = it->second->m_inherits.erase(inh);
-                else
-                    inh++;
+                std::filesystem::path indexPath { themeDir / "index.theme" };
+
+                if (std::filesystem::exists(indexPath) && std::filesystem::is_regular_file(indexPath))
+                    indexFilePath = indexPath;
             }
         }
-        else if (hicolor != m_themes.end())
-            it->second->m_inherits.emplace_back("hicolor");
     }
+    catch (const std::exception &) {}
 }
 
-void XDGIconThemeManager::updateCacheSerial()
+XDGMap<std::string, std::shared_ptr<XDGIconTheme>>::iterator XDGIconThemeManager::findTheme(std::string_view name) noexcept
 {
-    try {
-        m_cacheSerial = std::filesystem::last_write_time("/var/cache/xdgkit/icon_themes");
-    } catch (...) {
-    }
+    auto it { m_themes.find(name) };
+
+    // Not in the allowlist closure or not discovered yet (see XDGKit::Options::backgroundInit), load it on demand
+    if (it == m_themes.end() && loadTheme(name))
+        it = m_themes.find(name);
+
+    return it;
 }
 
-const XDGIcon *XDGIconThemeManager::findIconHelper(Search &search, std::shared_ptr<XDGIconTheme> theme) const noexcept
+bool XDGIconThemeManager::initTheme(XDGIconTheme &theme) noexcept
 {
-    if (search.visitedThemes.contains(theme))
-        return nullptr;
+    if (theme.m_indexFilePath.empty())
+        return false;
 
-    search.visitedThemes.emplace(theme);
+    theme.m_indexMtime = XDGUtils::modificationTime(theme.m_indexFilePath.c_str());
+    theme.loadCache();
 
-    int32_t distance;
+    if (!theme.m_usingCache)
+        theme.m_indexData = std::move(*XDGINIView::LoadFile(theme.m_indexFilePath).get());
 
-    for (const auto &dir : theme->scaledIconDirectories())
-    {
-        if ((dir.context() & search.contexts) == 0)
-            continue;
+    const auto &mainSection { theme.m_indexData.find("Icon Theme") };
 
-        const auto &icon = dir.icons().find(search.icon);
+    if (mainSection == theme.m_indexData.end())
+        return false;
 
-        if (icon == dir.icons().end() || (icon->second.extensions() & search.extensions) == 0)
-            continue;
+    // Required fields
+    const auto &name { mainSection->second.find("Name") };
+    const auto &comment { mainSection->second.find("Comment") };
+    const auto &directories { mainSection->second.find("Directories") };
 
-        if ((icon->second.extensions() & search.extensions & XDGIcon::SVG) != 0)
-            return &icon->second;
+    if (name == mainSection->second.end() || comment == mainSection->second.end() || directories == mainSection->second.end())
+        return false;
 
-        distance = directorySizeDistance(search, dir);
+    theme.m_displayName = name->second;
+    theme.m_comment = comment->second;
 
-        if (distance < search.bestDistance)
-        {
-            search.bestDistance = distance;
-            search.bestIcon = &icon->second;
-        }
+    theme.m_iconDirNames = XDGUtils::splitString(directories->second, ',', true);
 
-        if (!directoryMatchesSize(search, dir))
-            continue;
+    const auto &scaledDirectories { mainSection->second.find("ScaledDirectories") };
+    const auto &hidden { mainSection->second.find("Hidden") };
+    const auto &example { mainSection->second.find("Example") };
+    const auto &inherits { mainSection->second.find("Inherits") };
 
-        return &icon->second;
-    }
+    if (scaledDirectories != mainSection->second.end())
+        theme.m_scaledIconDirNames = XDGUtils::splitString(scaledDirectories->second, ',', true);
+
+    // Inherits is done later
+    if (inherits != mainSection->second.end())
+        theme.m_inheritsValue = inherits->second;
 
-    for (const auto &dir : theme->iconDirectories())
+    if (hidden != mainSection->second.end())
+        theme.m_hidden = hidden->second == "true";
+    if (example != mainSection->second.end())
+        theme.m_example = example->second;
+
+    if (m_kit.options().compactThemes)
     {
-        if ((dir.context() & search.contexts) == 0)
-            continue;
+        theme.compactInfo();
 
-        const auto &icon = dir.icons().find(search.icon);
+        // Themes without cache still need the directory names, released by initAllIconsDir()
+        theme.freeIndexData();
+    }
 
-        if (icon == dir.icons().end() || (icon->second.extensions() & search.extensions) == 0)
-            continue;
+    return true;
+}
 
-        if ((icon->second.extensions() & search.extensions & XDGIcon::SVG) != 0)
-            return &icon->second;
+void XDGIconThemeManager::resolveInherits(XDGIconTheme &theme) noexcept
+{
+    if (theme.name() == "hicolor")
+        return;
+
+    // Loaded on demand if discovered by the init thread
+    const bool hasHicolor { loadTheme("hicolor") != nullptr };
 
-        distance = directorySizeDistance(search, dir);
+    theme.m_inherits.clear();
+
+    if (!theme.m_inheritsValue.empty())
+    {
+        theme.m_inherits = XDGUtils::splitString(theme.m_inheritsValue, ',', true);
+        if (hasHicolor)
+            theme.m_inherits.emplace_back("hicolor");
+        XDGUtils::removeDuplicates(theme.m_inherits);
 
-        if (distance < search.bestDistance)
+        // Remove self and non existent inherits
+        for (auto inh = theme.m_inherits.begin(); inh != theme.m_inherits.end();)
         {
-            search.bestDistance = distance;
-            search.bestIcon = &icon->second;
+            if (*inh == theme.name() || !loadTheme(*inh))
+                inh = theme.m_inherits.erase(inh);
+            else
+                inh++;
         }
+    }
+    else if (hasHicolor)
+        theme.m_inherits.emplace_back("hicolor");
+}
 
-        if (!directoryMatchesSize(search, dir))
-            continue;
+void XDGIconThemeManager::updateCacheSerial()
+{
+    // stat() instead of std::filesystem::last_write_time() to avoid allocating a path on every lookup
+    struct stat st;
 
-        return &icon->second;
-    }
+    if (stat("/var/cache/xdgkit/icon_themes", &st) == 0)
+        m_cacheSerial = st.st_mtim;
+}
 
+const XDGIcon *XDGIconThemeManager::findIconHelper(Search &search, XDGIconTheme &theme) const noexcept
+{
+    if (theme.m_searchSerial == search.serial)
+        return nullptr;
+
+    theme.m_searchSerial = search.serial;
 
     const XDGIcon *found { nullptr };
-    for (const auto &parentIt : theme->inherits())
+
+    // Skip unloaded themes past the deadline, parents are still searched
+    if (search.skipped && !theme.initialized() && std::chrono::steady_clock::now() >= search.deadline)
+        search.skipped->emplace_back(&theme);
+    else
+    {
+        found = findIconInTheme(search, theme);
+        if (found) return found;
+    }
+
+    for (const auto &parentIt : theme.inherits())
     {
         const auto &parent = m_themes.find(parentIt);
-        found = findIconHelper(search, parent->second);
+        found = findIconHelper(search, *parent->second);
         if (found) return found;
     }
 
     return nullptr;
 }
 
-bool XDGIconThemeManager::directoryMatchesSize(Search &search, const XDGIconDirectory &dir) const noexcept
+const XDGIcon *XDGIconThemeManager::findIconInTheme(Search &search, const XDGIconTheme &theme) const noexcept
 {
-    if (search.scale != dir.scale())
-        return false;
+    if (theme.sizeClasses().size() <= XDGIconTheme::MaxSizeClasses)
+        return findIconByAvailability(search, theme);
 
-    if (dir.sizeType() == XDGIconDirectory::SizeType::Fixed)
-        return search.size == dir.size();
-    else if (dir.sizeType() == XDGIconDirectory::SizeType::Scalable)
-        return dir.minSize() <= search.size &&  search.size <= dir.maxSize();
-    else if (dir.sizeType() == XDGIconDirectory::SizeType::Threshold)
-        return dir.size() - dir.threshold() <= search.size && search.size <= dir.size() + dir.threshold();
+    Search *searches[] { &search };
+    const XDGIcon *found[] { nullptr };
+    findIconInIndex(searches, theme, found);
 
-    return false;
+    if (found[0])
+        return found[0];
+
+    keepClosestInTheme(search, theme);
+    return nullptr;
 }
 
-int32_t XDGIconThemeManager::directorySizeDistance(Search &search, const XDGIconDirectory &dir) const noexcept
+void XDGIconThemeManager::findIconInIndex(std::span<Search * const> searches, const XDGIconTheme &theme, std::span<const XDGIcon*> found) const noexcept
 {
-    if (dir.sizeType() == XDGIconDirectory::SizeType::Fixed)
-        return std::abs(search.bufferSize - dir.size() * dir.scale());
-    else if (dir.sizeType() == XDGIconDirectory::SizeType::Scalable)
+    /*
+     * Same result as walking the directories in search order and returning, for each search, the first icon that
+     * matches the size or has an SVG file, but only directories of the requested scale (via the index)
+     * and directories containing SVG icons are checked. The searches share the size, scale and contexts,
+     * so each matching directory is probed for all the names.
+     */
+    const Search &first { *searches.front() };
+    const auto &index { theme.index() };
+    uint32_t foundOrder[MaxIndexSearches];
+    std::fill_n(foundOrder, searches.size(), std::numeric_limits<uint32_t>::max());
+
+    for (uint32_t bucket = 0; bucket < 5; bucket++)
     {
-        if (search.bufferSize < dir.minSize() * dir.scale())
-            return dir.minSize() * dir.scale() - search.bufferSize;
-        else if (search.bufferSize > dir.maxSize() * dir.scale())
-            return search.bufferSize - dir.maxSize() * dir.scale();
+        if ((first.contexts & (1 << bucket)) == 0)
+            continue;
+
+        const auto end { index.entries.begin() + index.contextBegin[bucket + 1] };
+        auto it = std::lower_bound(index.entries.begin() + index.contextBegin[bucket], end, first.scale,
+            [](const auto &entry, int32_t scale) { return entry.scale < scale; });
+
+        for (; it != end && it->scale == first.scale; it++)
+        {
+            if (!XDGSizeBatch::MatchesSize(*it->dir->data(), first.size, first.scale))
+                continue;
+
+            for (size_t i = 0; i < searches.size(); i++)
+            {
+                if (it->dir->m_order >= foundOrder[i])
+                    continue;
+
+                const XDGIcon *icon { findIconInDirectory(*searches[i], *it->dir) };
+
+                if (icon)
+                {
+                    found[i] = icon;
+                    foundOrder[i] = it->dir->m_order;
+                }
+            }
+        }
     }
-    else if (dir.sizeType() == XDGIconDirectory::SizeType::Threshold)
+
+    for (const auto *dir : index.svgDirs)
     {
-        if (search.bufferSize < (dir.size() - dir.threshold()) * dir.scale())
-            return (dir.size() - dir.threshold()) * dir.scale() - search.bufferSize;
-        else if (search.bufferSize > (dir.maxSize() + dir.threshold()) * dir.scale())
-            return search.bufferSize - (dir.maxSize() + dir.threshold()) * dir.scale();
+        bool pending { false };
+
+        for (size_t i = 0; i < searches.size(); i++)
+        {
+            if (dir->m_order >= foundOrder[i])
+                continue;
+
+            pending = true;
+            const XDGIcon *icon { findIconInDirectory(*searches[i], *dir) };
+
+            if (icon && (icon->extensions() & searches[i]->extensions & XDGIcon::SVG) != 0)
+            {
+                found[i] = icon;
+                foundOrder[i] = dir->m_order;
+            }
+        }
+
+        if (!pending)
+            break;
     }
+}
+
+void XDGIconThemeManager::keepClosestInTheme(Search &search, const XDGIconTheme &theme) const noexcept
+{
+    // No match, keep the closest icon in case no other theme has a match
+    int32_t cost;
+    const XDGIcon *closest { findClosestInTheme(search, theme, 1, false, cost) };
 
-    return std::numeric_limits<int32_t>::max() - 1;
+    if (closest)
+    {
+        search.bestDistance = cost;
+        search.bestIcon = closest;
+    }
 }
 
-bool XDGIconThemeManager::reloadThemes(bool onlyIfCacheChanged) noexcept
+const XDGIcon *XDGIconThemeManager::findSymbolicIconHelper(Search &symbolic, Search &regular, XDGIconTheme &theme) const noexcept
 {
-    if (onlyIfCacheChanged)
+    // Same traversal as findIconHelper()
+    if (theme.m_searchSerial == symbolic.serial)
+        return nullptr;
+
+    theme.m_searchSerial = symbolic.serial;
+
+    const XDGIcon *found { findSymbolicIconInTheme(symbolic, regular, theme) };
+    if (found) return found;
+
+    for (const auto &parent : theme.inherits())
     {
-        const auto currentCacheSerial { m_cacheSerial };
-        updateCacheSerial();
+        found = findSymbolicIconHelper(symbolic, regular, *m_themes.find(parent)->second);
+        if (found) return found;
+    }
 
-        if (m_cacheSerial == currentCacheSerial)
-            return false;
+    return nullptr;
+}
 
-        XDGLog(CZDebug, CZLN, "The icons theme cache changed");
+const XDGIcon *XDGIconThemeManager::findSymbolicIconInTheme(Search &symbolic, Search &regular, const XDGIconTheme &theme) const noexcept
+{
+    // Same as calling findIconInTheme() for each name, the availability bitmaps already skip directories without the icon
+    if (theme.sizeClasses().size() <= XDGIconTheme::MaxSizeClasses)
+    {
+        const XDGIcon *found { findIconByAvailability(symbolic, theme) };
+        return found ? found : findIconByAvailability(regular, theme);
     }
-    else
-        updateCacheSerial();
 
-    m_themes.clear();
-    m_searchDirs.clear();
-    kit().m_stringPool.clear();
+    // Otherwise both names are looked up while walking the index once
+    Search *searches[] { &symbolic, &regular };
+    const XDGIcon *found[] { nullptr, nullptr };
+    findIconInIndex(searches, theme, found);
 
-    kit().rescanDataDirs();
-    restoreDefaultSearchDirs();
-    findThemes();
-    XDGLog(CZInfo, CZLN, "Icon themes reloaded");
-    return true;
+    if (found[0])
+        return found[0];
+
+    keepClosestInTheme(symbolic, theme);
+
+    if (found[1])
+        return found[1];
+
+    keepClosestInTheme(regular, theme);
+    return nullptr;
 }
 
-const XDGIcon *XDGIconThemeManager::findIcon(const std::string &icon, int32_t size, int32_t scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+// Cost multiplier for directories whose icons must be upscaled (blurry) in findIconFractional()
+static constexpr int32_t UpscalePenalty { 2 };
+
+bool XDGIconThemeManager::findIconFractionalHelper(Search &search, XDGIconTheme &theme) const noexcept
 {
-    Search search
-    {
-        .icon = icon,
-        .size = size,
-        .scale = scale,
-        .bufferSize = size * scale,
-        .extensions = extensions,
-        .contexts = contexts,
-        .themes = {},
-        .visitedThemes = {}
-    };
+    // Same traversal as findIconHelper(), returns true once an icon covering the buffer size is found
+    if (theme.m_searchSerial == search.serial)
+        return false;
 
-    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
-        reloadThemes(true);
+    theme.m_searchSerial = search.serial;
 
-    if ((extensions & (1 | 2 | 4)) == 0 || scale <= 0 || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+    if (findIconFractionalInTheme(search, theme))
+        return true;
+
+    for (const auto &parent : theme.inherits())
+        if (findIconFractionalHelper(search, *m_themes.find(parent)->second))
+            return true;
+
+    return false;
+}
+
+uint64_t XDGIconThemeManager::availableSizeClasses(std::string_view icon, uint32_t extensions, uint32_t contexts, const XDGIconTheme &theme, uint64_t *svgMask) const noexcept
+{
+    if (theme.sizeClasses().size() > XDGIconTheme::MaxSizeClasses)
+        return AllSizeClasses;
+
+    const auto &availability { theme.iconAvailability().find(icon) };
+
+    if (availability == theme.iconAvailability().end())
+        return 0;
+
+    uint64_t contextMask { 0 };
+
+    for (uint32_t bucket = 0; bucket < 5; bucket++)
+        if ((contexts & (1 << bucket)) != 0)
+            contextMask |= theme.m_contextSizeClasses[bucket];
+
+    const uint64_t mask { availability->second.mask(extensions) & contextMask };
+
+    if (svgMask)
+        *svgMask = (extensions & XDGIcon::SVG) ? availability->second.svg & mask : 0;
+
+    return mask;
+}
+
+const XDGIcon *XDGIconThemeManager::findIconByAvailability(Search &search, const XDGIconTheme &theme) const noexcept
+{
+    // Same result as findIconInTheme(), using the size classes in which the icon is available
+    uint64_t svgMask;
+    const uint64_t mask { availableSizeClasses(search.icon, search.extensions, search.contexts, theme, &svgMask) };
+
+    if (mask == 0)
         return nullptr;
 
-    search.themes.reserve(m_themes.size());
+    const auto &sizeClasses { theme.sizeClasses() };
+    const XDGIcon *found { nullptr };
+    uint32_t foundOrder { std::numeric_limits<uint32_t>::max() };
 
-    for (auto &theme : themes)
+    // First directory in search order matching the size or with an SVG file
+    for (uint64_t bits = mask; bits; bits &= bits - 1)
     {
-        if (theme == "")
-        {
-            for (auto &T : m_themes)
-                search.themes.emplace_back(T.second);
+        const uint32_t i { static_cast<uint32_t>(std::countr_zero(bits)) };
+        const bool exact { XDGSizeBatch::MatchesSize(sizeClasses[i].geometry, search.size, search.scale) };
 
+        if (!exact && (svgMask & (uint64_t(1) << i)) == 0)
             continue;
-        }
 
-        const auto &it = m_themes.find(theme);
+        for (const auto *dir : sizeClasses[i].directories)
+        {
+            if (dir->m_order >= foundOrder)
+                break;
 
-        if (it == m_themes.end())
-            continue;
+            const XDGIcon *icon { findIconInDirectory(search, *dir) };
 
-        search.themes.emplace_back(it->second);
+            if (icon && (exact || (icon->extensions() & search.extensions & XDGIcon::SVG) != 0))
+            {
+                found = icon;
+                foundOrder = dir->m_order;
+                break;
+            }
+        }
     }
 
-    XDGUtils::removeDuplicates(search.themes);
+    if (found)
+        return found;
 
-    if (search.themes.empty())
-        return nullptr;
+    // No match, keep the closest icon in case no other theme has a match
+    int32_t closestDistance { search.bestDistance };
 
-    search.visitedThemes.reserve(m_themes.size());
+    for (uint64_t bits = mask; bits; bits &= bits - 1)
+    {
+        const auto &sizeClass { sizeClasses[std::countr_zero(bits)] };
 
-    const XDGIcon *found { nullptr };
+        if ((sizeClass.geometry.sizeType & (XDGIconDirectory::Fixed | XDGIconDirectory::Scalable | XDGIconDirectory::Threshold)) == 0)
+            continue;
 
-    for (const auto &theme : search.themes)
-    {
-        found = findIconHelper(search, theme);
-        if (found) return found;
-    }
+        const int32_t distance { XDGSizeBatch::SizeDistance(sizeClass.geometry, search.bufferSize) };
 
-    if (!search.bestIcon && (search.contexts & XDGIconDirectory::AnyContext) == XDGIconDirectory::AnyContext)
-        kit().m_stringPool.erase(icon);
+        if (distance > closestDistance || (distance == closestDistance && found == nullptr))
+            continue;
 
-    return search.bestIcon;
+        for (const auto *dir : sizeClass.directories)
+        {
+            if (distance == closestDistance && dir->m_order >= foundOrder)
+                break;
+
+            const XDGIcon *icon { findIconInDirectory(search, *dir) };
+
+            if (icon)
+            {
+                found = icon;
+                foundOrder = dir->m_order;
+                closestDistance = distance;
+                break;
+            }
+        }
+    }
+
+    if (found)
+    {
+        search.bestDistance = closestDistance;
+        search.bestIcon = found;
+    }
+
+    return nullptr;
+}
+
+bool XDGIconThemeManager::findIconFractionalInTheme(Search &search, const XDGIconTheme &theme) const noexcept
+{
+    int32_t cost;
+    const XDGIcon *closest { findClosestInTheme(search, theme, UpscalePenalty, true, cost) };
+
+    if (!closest)
+        return false;
+
+    search.bestDistance = cost;
+    search.bestIcon = closest;
+    return cost == 0;
+}
+
+const XDGIcon *XDGIconThemeManager::findClosestInTheme(Search &search, const XDGIconTheme &theme, int32_t upscalePenalty, bool rangesMatch, int32_t &cost) const noexcept
+{
+    const auto &table { theme.bufferSizes() };
+    const int32_t buffer { search.bufferSize };
+    const XDGIcon *found { nullptr };
+    uint32_t foundOrder { std::numeric_limits<uint32_t>::max() };
+
+    // byMin[0, below) have min <= buffer, byMin[below, end) are downscaled
+    const size_t below = std::upper_bound(table.byMin.begin(), table.byMin.end(), buffer,
+        [](int32_t b, const auto &range) { return b < range.min; }) - table.byMin.begin();
+
+    // byMax[0, above) are upscaled
+    const size_t above = std::lower_bound(table.byMax.begin(), table.byMax.end(), buffer,
+        [](const auto &range, int32_t b) { return range.max < b; }) - table.byMax.begin();
+
+    // Directories covering the buffer size, ties are resolved by search order
+    if (search.bestDistance > 0)
+    {
+        for (size_t i = 0; i < below; i++)
+        {
+            if (table.byMin[i].max < buffer || table.byMin[i].dir->m_order >= foundOrder)
+                continue;
+
+            if (!rangesMatch && table.byMin[i].dir->sizeType() != XDGIconDirectory::Fixed)
+                continue;
+
+            const XDGIcon *icon { findIconInDirectory(search, *table.byMin[i].dir) };
+
+            if (icon)
+            {
+                found = icon;
+                foundOrder = table.byMin[i].dir->m_order;
+            }
+        }
+    }
+
+    if (found)
+    {
+        cost = 0;
+        return found;
+    }
+
+    // Expand outwards from the buffer size until a closer directory can't be found
+    size_t down { below }, up { above };
+
+    while (down < table.byMin.size() || up > 0)
+    {
+        const int32_t downCost { down < table.byMin.size() ? table.byMin[down].min - buffer : std::numeric_limits<int32_t>::max() };
+        const int32_t upCost { up > 0 ? (buffer - table.byMax[up - 1].max) * upscalePenalty : std::numeric_limits<int32_t>::max() };
+        const bool downscale { downCost <= upCost };
+        const int32_t nextCost { downscale ? downCost : upCost };
+
+        if (nextCost >= search.bestDistance || (found && nextCost > cost))
+            break;
+
+        const XDGIconDirectory &dir { downscale ? *table.byMin[down++].dir : *table.byMax[--up].dir };
+
+        if (dir.m_order >= foundOrder)
+            continue;
+
+        const XDGIcon *icon { findIconInDirectory(search, dir) };
+
+        if (icon)
+        {
+            found = icon;
+            foundOrder = dir.m_order;
+            cost = nextCost;
+        }
+    }
+
+    if (found || rangesMatch)
+        return found;
+
+    // Scalable and Threshold directories containing the buffer size are the last resort (see XDGSizeBatch::SizeDistance())
+    for (size_t i = 0; i < below; i++)
+    {
+        const XDGIconDirectory &dir { *table.byMin[i].dir };
+
+        if (table.byMin[i].max < buffer || dir.sizeType() == XDGIconDirectory::Fixed || dir.m_order >= foundOrder)
+            continue;
+
+        const int32_t distance { XDGSizeBatch::SizeDistance(*dir.data(), buffer) };
+
+        if (distance >= search.bestDistance)
+            continue;
+
+        const XDGIcon *icon { findIconInDirectory(search, dir) };
+
+        if (icon)
+        {
+            found = icon;
+            foundOrder = dir.m_order;
+            cost = distance;
+        }
+    }
+
+    return found;
+}
+
+const XDGIcon *XDGIconThemeManager::findIconInDirectory(Search &search, const XDGIconDirectory &dir) const noexcept
+{
+    if ((dir.context() & search.contexts) == 0)
+        return nullptr;
+
+    const XDGIcon *icon { dir.icons().find(search.icon) };
+
+    if (!icon || (icon->extensions() & search.extensions) == 0)
+        return nullptr;
+
+    return icon;
+}
+
+void XDGIconThemeManager::collectCandidates(Search &search, XDGIconTheme &theme) const noexcept
+{
+    // Same traversal as findIconHelper() but without stopping at the first match
+    if (theme.m_searchSerial == search.serial)
+        return;
+
+    theme.m_searchSerial = search.serial;
+    collectCandidatesInTheme(search, theme);
+
+    for (const auto &parent : theme.inherits())
+        collectCandidates(search, *m_themes.find(parent)->second);
+}
+
+void XDGIconThemeManager::collectCandidatesInTheme(Search &search, const XDGIconTheme &theme) const noexcept
+{
+    // Directories are visited in search order (which ranks equal candidates), skipping size classes without the icon
+    const uint64_t mask { availableSizeClasses(search.icon, search.extensions, search.contexts, theme) };
+
+    if (mask == 0)
+        return;
+
+    for (const auto *dirs : { &theme.scaledIconDirectories(), &theme.iconDirectories() })
+    {
+        for (const auto &dir : *dirs)
+        {
+            if ((dir.context() & search.contexts) == 0 || !inSizeClasses(mask, dir))
+                continue;
+
+            const XDGIcon *icon { dir.icons().find(search.icon) };
+
+            if (!icon || (icon->extensions() & search.extensions) == 0)
+                continue;
+
+            search.candidateIcons[search.candidates.size()] = icon;
+            search.candidates.push(*dir.data());
+
+            if (search.candidates.full())
+                rankCandidates(search);
+        }
+    }
+
+    rankCandidates(search);
+}
+
+void XDGIconThemeManager::rankCandidates(Search &search) const noexcept
+{
+    if (search.candidates.empty())
+        return;
+
+    search.candidates.score(search.size, search.scale);
+
+    for (uint32_t i = 0; i < search.candidates.size(); i++)
+    {
+        const Candidate candidate
+        {
+            .icon = search.candidateIcons[i],
+            .directory = &search.candidateIcons[i]->directory(),
+            .distance = search.candidates.distance(i),
+            .exactMatch = search.candidates.matches(i)
+        };
+
+        // Insert after candidates of equal rank to preserve the visit order
+        size_t pos { search.resultCount };
+
+        while (pos > 0)
+        {
+            const Candidate &prev { search.results[pos - 1] };
+
+            if (prev.exactMatch > candidate.exactMatch ||
+                (prev.exactMatch == candidate.exactMatch && prev.distance <= candidate.distance))
+                break;
+
+            pos--;
+        }
+
+        if (pos == search.results.size())
+            continue;
+
+        const size_t last { std::min(search.resultCount, search.results.size() - 1) };
+
+        for (size_t j = last; j > pos; j--)
+            search.results[j] = search.results[j - 1];
+
+        search.results[pos] = candidate;
+
+        if (search.resultCount < search.results.size())
+            search.resultCount++;
+    }
+
+    search.candidates.clear();
+}
+
+bool XDGIconThemeManager::findIconsHelper(MultiSearch &search, XDGIconTheme &theme) const noexcept
+{
+    // Same traversal as findIconHelper(), returns true once all targets are resolved
+    if (theme.m_searchSerial == search.serial)
+        return false;
+
+    theme.m_searchSerial = search.serial;
+
+    if (findIconsInTheme(search, theme))
+        return true;
+
+    for (const auto &parent : theme.inherits())
+        if (findIconsHelper(search, *m_themes.find(parent)->second))
+            return true;
+
+    return false;
+}
+
+bool XDGIconThemeManager::findIconsInTheme(MultiSearch &search, const XDGIconTheme &theme) const noexcept
+{
+    // Directories are visited in search order (targets keep the first exact match), skipping size classes without the icon
+    const uint64_t mask { availableSizeClasses(search.icon, search.extensions, search.contexts, theme) };
+
+    if (mask == 0)
+        return false;
+
+    for (const auto *dirs : { &theme.scaledIconDirectories(), &theme.iconDirectories() })
+    {
+        for (const auto &dir : *dirs)
+        {
+            if ((dir.context() & search.contexts) == 0 || !inSizeClasses(mask, dir))
+                continue;
+
+            const XDGIcon *icon { dir.icons().find(search.icon) };
+
+            if (!icon || (icon->extensions() & search.extensions) == 0)
+                continue;
+
+            // Previous candidates have priority over the SVG, which resolves all remaining targets
+            if ((icon->extensions() & search.extensions & XDGIcon::SVG) != 0)
+            {
+                scoreTargets(search);
+
+                for (size_t t = 0; t < search.targets.size(); t++)
+                {
+                    if (search.resolved[t])
+                        continue;
+
+                    search.resolved[t] = true;
+                    search.results[t] = icon;
+                }
+
+                search.pending = 0;
+                return true;
+            }
+
+            search.candidateIcons[search.candidates.size()] = icon;
+            search.candidates.push(*dir.data());
+
+            if (search.candidates.full())
+            {
+                scoreTargets(search);
+                if (search.pending == 0) return true;
+            }
+        }
+    }
+
+    scoreTargets(search);
+    return search.pending == 0;
+}
+
+void XDGIconThemeManager::scoreTargets(MultiSearch &search) const noexcept
+{
+    if (search.candidates.empty())
+        return;
+
+    for (size_t t = 0; t < search.targets.size(); t++)
+    {
+        if (search.resolved[t])
+            continue;
+
+        search.candidates.score(search.targets[t].size, search.targets[t].scale);
+
+        for (uint32_t i = 0; i < search.candidates.size(); i++)
+        {
+            if (search.candidates.distance(i) < search.bestDistance[t])
+            {
+                search.bestDistance[t] = search.candidates.distance(i);
+                search.results[t] = search.candidateIcons[i];
+            }
+
+            if (search.candidates.matches(i))
+            {
+                search.resolved[t] = true;
+                search.results[t] = search.candidateIcons[i];
+                search.pending--;
+                break;
+            }
+        }
+    }
+
+    search.candidates.clear();
+}
+
+void XDGIconThemeManager::buildSearchOrder(std::span<const std::string> themes, std::vector<XDGIconTheme *> &order) noexcept
+{
+    const uint64_t serial { ++m_searchSerial };
+    order.clear();
+
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+                appendSearchOrder(*T.second, serial, order);
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it != m_themes.end())
+            appendSearchOrder(*it->second, serial, order);
+    }
+}
+
+void XDGIconThemeManager::appendSearchOrder(XDGIconTheme &theme, uint64_t serial, std::vector<XDGIconTheme *> &order) noexcept
+{
+    // Same traversal as findIconHelper()
+    if (theme.m_searchSerial == serial)
+        return;
+
+    theme.m_searchSerial = serial;
+    order.emplace_back(&theme);
+
+    for (const auto &parent : theme.inherits())
+        appendSearchOrder(*m_themes.find(parent)->second, serial, order);
+}
+
+int32_t XDGIconThemeManager::directorySizeDistance(Search &search, const XDGIconDirectory &dir) const noexcept
+{
+    return XDGSizeBatch::SizeDistance(*dir.data(), search.bufferSize);
+}
+
+bool XDGIconThemeManager::reloadThemes(bool onlyIfCacheChanged) noexcept
+{
+    if (onlyIfCacheChanged)
+    {
+        const auto currentCacheSerial { m_cacheSerial };
+        updateCacheSerial();
+
+        if (m_cacheSerial.tv_sec == currentCacheSerial.tv_sec && m_cacheSerial.tv_nsec == currentCacheSerial.tv_nsec)
+            return false;
+
+        XDGLog(CZDebug, CZLN, "The icons theme cache changed");
+    }
+    else
+        updateCacheSerial();
+
+    // The init thread reads the search dirs
+    mergeDiscoveredThemes();
+    kit().rescanDataDirs();
+    restoreDefaultSearchDirs();
+
+    // Only themes whose sources changed are replaced, others keep their mappings, directories and handles
+    std::vector<std::filesystem::path> dirs;
+    std::filesystem::path indexFilePath;
+    size_t replaced { 0 };
+
+    for (auto it = m_themes.begin(); it != m_themes.end();)
+    {
+        findThemeDirs(it->first, dirs, indexFilePath);
+
+        if (!it->second->sourcesChanged(dirs, indexFilePath))
+        {
+            it++;
+            continue;
+        }
+
+        auto &slot { m_themeSlots[it->second->m_slot] };
+        slot.theme = nullptr;
+        slot.generation++;
+        it = m_themes.erase(it);
+        replaced++;
+    }
+
+    const size_t kept { m_themes.size() };
+
+    // Changed and new themes, names missing before may exist now
+    m_missingThemes.clear();
+    m_allThemesFound = false;
+
+    if (!kit().options().themes.empty())
+    {
+        loadTheme("hicolor");
+
+        for (const auto &theme : kit().options().themes)
+            loadTheme(theme);
+    }
+    else
+        findAllThemes();
+
+    // Inherited themes may have been added or removed (resolveInherits() can load themes, so pointers are taken first)
+    std::vector<XDGIconTheme*> themes;
+    themes.reserve(m_themes.size());
+
+    for (auto &theme : m_themes)
+        themes.emplace_back(theme.second.get());
+
+    for (XDGIconTheme *theme : themes)
+        resolveInherits(*theme);
+
+    if (replaced == 0 && m_themes.size() == kept)
+    {
+        XDGLog(CZDebug, CZLN, "Icon themes unchanged");
+        return false;
+    }
+
+    m_generation++;
+
+    const auto replacedTheme { [this](const std::shared_ptr<XDGIconTheme> &theme) {
+        return m_themeSlots[theme->m_slot].theme != theme.get(); } };
+
+    // Replaced themes won't be loaded, let pending lookups query the new ones
+    {
+        std::lock_guard<std::mutex> lock { m_loaderMutex };
+        std::erase_if(m_loadQueue, replacedTheme);
+    }
+
+    bool released { false };
+
+    for (auto &pending : m_pendingLookups)
+    {
+        if (std::any_of(pending.themes.begin(), pending.themes.end(), replacedTheme))
+        {
+            pending.themes.clear();
+            released = true;
+        }
+    }
+
+    if (released)
+    {
+        const uint64_t one { 1 };
+        if (m_loaderFd != -1 && write(m_loaderFd, &one, sizeof(one)) != sizeof(one))
+            XDGLog(CZWarning, CZLN, "Failed to signal the loader fd");
+    }
+
+    XDGLog(CZInfo, CZLN, "Icon themes reloaded ({} replaced, {} added)", replaced, m_themes.size() - kept);
+    notifyManifests();
+    return true;
+}
+
+void XDGIconThemeManager::notifyManifests() noexcept
+{
+    // All are updated before any callback, which may create or destroy manifests
+    std::vector<XDGIconManifest*> changed;
+
+    for (XDGIconManifest *manifest : m_manifests)
+        if (manifest->update())
+            changed.emplace_back(manifest);
+
+    for (XDGIconManifest *manifest : changed)
+        if (manifest->m_callback && std::find(m_manifests.begin(), m_manifests.end(), manifest) != m_manifests.end())
+            manifest->m_callback();
+}
+
+const XDGIcon *XDGIconThemeManager::findIcon(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findIconImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+const XDGIcon *XDGIconThemeManager::findIcon(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findIconImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+template <class Themes>
+const XDGIcon *XDGIconThemeManager::findIconImpl(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
+        reloadThemes(true);
+
+    maybeTrimMemory();
+
+    if ((extensions & (1 | 2 | 4)) == 0 || scale <= 0 || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+        return nullptr;
+
+    Search search
+    {
+        .icon = icon,
+        .size = size,
+        .scale = scale,
+        .bufferSize = size * scale,
+        .extensions = extensions,
+        .contexts = contexts,
+        .serial = ++m_searchSerial
+    };
+
+    const XDGIcon *found { nullptr };
+
+    // Already visited themes (duplicates) are skipped by findIconHelper()
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+            {
+                found = findIconHelper(search, *T.second);
+                if (found) return found;
+            }
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it == m_themes.end())
+            continue;
+
+        found = findIconHelper(search, *it->second);
+        if (found) return found;
+    }
+
+    return search.bestIcon;
+}
+
+const XDGIcon *XDGIconThemeManager::findIconNonBlocking(LookupStatus &status, std::chrono::steady_clock::time_point deadline, std::function<void()> onLoaded,
+    std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findIconNonBlockingImpl(status, deadline, std::move(onLoaded), icon, size, scale, extensions, themes, contexts);
+}
+
+const XDGIcon *XDGIconThemeManager::findIconNonBlocking(LookupStatus &status, std::chrono::steady_clock::time_point deadline, std::function<void()> onLoaded,
+    std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findIconNonBlockingImpl(status, deadline, std::move(onLoaded), icon, size, scale, extensions, themes, contexts);
+}
+
+template <class Themes>
+const XDGIcon *XDGIconThemeManager::findIconNonBlockingImpl(LookupStatus &status, std::chrono::steady_clock::time_point deadline, std::function<void()> &&onLoaded,
+    std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    status = Complete;
+
+    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
+        reloadThemes(true);
+
+    maybeTrimMemory();
+
+    if ((extensions & (1 | 2 | 4)) == 0 || scale <= 0 || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+        return nullptr;
+
+    std::vector<XDGIconTheme*> skipped;
+
+    Search search
+    {
+        .icon = icon,
+        .size = size,
+        .scale = scale,
+        .bufferSize = size * scale,
+        .extensions = extensions,
+        .contexts = contexts,
+        .serial = ++m_searchSerial,
+        .skipped = &skipped,
+        .deadline = deadline
+    };
+
+    const XDGIcon *found { nullptr };
+
+    // Same traversal as findIconImpl()
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+            {
+                found = findIconHelper(search, *T.second);
+                if (found) goto done;
+            }
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it == m_themes.end())
+            continue;
+
+        found = findIconHelper(search, *it->second);
+        if (found) goto done;
+    }
+
+    found = search.bestIcon;
+
+done:
+    if (skipped.empty())
+        return found;
+
+    PendingLookup pending;
+    bool scheduled { true };
+
+    for (XDGIconTheme *theme : skipped)
+    {
+        scheduled &= scheduleLoad(*theme);
+
+        if (onLoaded)
+            pending.themes.emplace_back(m_themes.find(theme->name())->second);
+    }
+
+    // Without the background loader the skipped themes would never be loaded
+    if (!scheduled)
+        return found;
+
+    status = Partial;
+
+    if (onLoaded)
+    {
+        pending.callback = std::move(onLoaded);
+        m_pendingLookups.emplace_back(std::move(pending));
+    }
+
+    return found;
+}
+
+XDGIconFuture XDGIconThemeManager::findIconAsync(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findIconAsyncImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+XDGIconFuture XDGIconThemeManager::findIconAsync(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findIconAsyncImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+template <class Themes>
+XDGIconFuture XDGIconThemeManager::findIconAsyncImpl(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    XDGIconFuture future;
+    future.m_state = std::make_shared<XDGIconFuture::State>();
+
+    auto lookup { std::make_shared<AsyncLookup>(std::string(icon), size, scale, extensions,
+        std::vector<std::string>(themes.begin(), themes.end()), contexts) };
+
+    resolveAsync(future.m_state, lookup);
+    return future;
+}
+
+void XDGIconThemeManager::resolveAsync(const std::shared_ptr<XDGIconFuture::State> &state, const std::shared_ptr<AsyncLookup> &lookup) noexcept
+{
+    LookupStatus status;
+
+    // Retried once the skipped themes are loaded, or with the new themes after reloadThemes()
+    const XDGIcon *icon { findIconNonBlocking(status, NeverBlock,
+        [this, state, lookup]{ resolveAsync(state, lookup); },
+        lookup->icon, lookup->size, lookup->scale, lookup->extensions, lookup->themes, lookup->contexts) };
+
+    if (status == Complete)
+        state->resolve(icon);
+}
+
+bool XDGIconThemeManager::scheduleLoad(XDGIconTheme &theme) noexcept
+{
+    if (theme.m_loadScheduled)
+        return true;
+
+    if (loaderFd() == -1)
+    {
+        XDGLog(CZWarning, CZLN, "Failed to create the loader fd, theme {} won't be loaded in the background", theme.name());
+        return false;
+    }
+
+    if (!startLoader())
+        return false;
+
+    theme.m_loadScheduled = true;
+
+    {
+        std::lock_guard<std::mutex> lock { m_loaderMutex };
+        m_loadQueue.emplace_back(m_themes.find(theme.name())->second);
+    }
+
+    m_loaderCond.notify_one();
+    return true;
+}
+
+bool XDGIconThemeManager::startLoader() noexcept
+{
+    if (m_loaderThread.joinable())
+        return true;
+
+    try
+    {
+        m_loaderThread = std::thread(&XDGIconThemeManager::loaderMain, this);
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        XDGLog(CZWarning, CZLN, "Failed to start the loader thread: {}", e.what());
+        return false;
+    }
+}
+
+void XDGIconThemeManager::prefetch(std::span<const XDGIcon * const> icons, uint32_t extensions) noexcept
+{
+    std::vector<const XDGIcon*> sorted;
+    sorted.reserve(icons.size());
+
+    for (const XDGIcon *icon : icons)
+        if (icon && (icon->extensions() & extensions & (XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM)))
+            sorted.emplace_back(icon);
+
+    if (sorted.empty() || !startLoader())
+        return;
+
+    // Batched per directory, each one is opened once by the loader
+    std::sort(sorted.begin(), sorted.end(), [](const XDGIcon *a, const XDGIcon *b) {
+        if (&a->directory() != &b->directory())
+            return std::less<>{}(&a->directory(), &b->directory());
+        return std::less<>{}(a, b); });
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    std::vector<PrefetchBatch> batches;
+    const XDGIconDirectory *currentDir { nullptr };
+
+    for (const XDGIcon *icon : sorted)
+    {
+        if (&icon->directory() != currentDir)
+        {
+            currentDir = &icon->directory();
+            batches.emplace_back().dir = currentDir->path();
+        }
+
+        for (const auto ext : { XDGIcon::PNG, XDGIcon::SVG, XDGIcon::XPM })
+        {
+            if ((icon->extensions() & extensions & ext) == 0)
+                continue;
+
+            auto &file { batches.back().files.emplace_back(icon->name()) };
+            file += XDGIcon::ExtensionSuffix(ext);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock { m_loaderMutex };
+
+        for (auto &batch : batches)
+            m_prefetchQueue.emplace_back(std::move(batch));
+    }
+
+    m_loaderCond.notify_one();
+}
+
+void XDGIconThemeManager::prefetch(std::span<XDGIconHandle> handles, uint32_t extensions) noexcept
+{
+    std::vector<const XDGIcon*> icons;
+    icons.reserve(handles.size());
+
+    for (auto &handle : handles)
+        icons.emplace_back(resolve(handle));
+
+    prefetch(icons, extensions);
+}
+
+void XDGIconThemeManager::prefetchBatch(const PrefetchBatch &batch) noexcept
+{
+    const int dirFd { open(batch.dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC) };
+
+    if (dirFd == -1)
+        return;
+
+    for (const auto &file : batch.files)
+    {
+        const int fd { openat(dirFd, file.c_str(), O_RDONLY | O_CLOEXEC) };
+
+        if (fd == -1)
+            continue;
+
+        // Starts reading the whole file into the page cache asynchronously
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+
+    close(dirFd);
+}
+
+void XDGIconThemeManager::loaderMain() noexcept
+{
+    const uint64_t one { 1 };
+
+    while (true)
+    {
+        std::shared_ptr<XDGIconTheme> theme;
+        PrefetchBatch batch;
+
+        {
+            std::unique_lock<std::mutex> lock { m_loaderMutex };
+            m_loaderCond.wait(lock, [this]{ return m_loaderStop || !m_loadQueue.empty() || !m_prefetchQueue.empty(); });
+
+            if (m_loaderStop)
+                return;
+
+            // Theme loads first, lookups are waiting for them
+            if (!m_loadQueue.empty())
+            {
+                theme = std::move(m_loadQueue.front());
+                m_loadQueue.pop_front();
+            }
+            else
+            {
+                batch = std::move(m_prefetchQueue.front());
+                m_prefetchQueue.pop_front();
+            }
+        }
+
+        if (!theme)
+        {
+            prefetchBatch(batch);
+            continue;
+        }
+
+        // Loads the theme if not already loaded by a blocking lookup
+        theme->iconDirectories();
+
+        if (write(m_loaderFd, &one, sizeof(one)) != sizeof(one))
+            XDGLog(CZWarning, CZLN, "Failed to signal the loader fd");
+    }
+}
+
+void XDGIconThemeManager::stopLoader() noexcept
+{
+    if (m_loaderThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_loaderMutex };
+            m_loaderStop = true;
+        }
+
+        m_loaderCond.notify_one();
+        m_loaderThread.join();
+    }
+
+    m_loadQueue.clear();
+    m_prefetchQueue.clear();
+    m_pendingLookups.clear();
+
+    if (m_loaderFd != -1)
+    {
+        close(m_loaderFd);
+        m_loaderFd = -1;
+    }
+}
+
+XDGIconThemeManager::~XDGIconThemeManager()
+{
+    stopLoader();
+
+    // Manifests may outlive the kit
+    for (XDGIconManifest *manifest : m_manifests)
+        manifest->m_manager = nullptr;
+
+    if (m_pressureFd != -1)
+        close(m_pressureFd);
+}
+
+int XDGIconThemeManager::loaderFd() noexcept
+{
+    if (m_loaderFd == -1)
+        m_loaderFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    return m_loaderFd;
+}
+
+void XDGIconThemeManager::dispatchLoaded() noexcept
+{
+    uint64_t count;
+
+    if (m_loaderFd == -1 || read(m_loaderFd, &count, sizeof(count)) != sizeof(count))
+        return;
+
+    // Callbacks may perform new lookups and append to m_pendingLookups
+    std::vector<std::function<void()>> ready;
+
+    for (auto it = m_pendingLookups.begin(); it != m_pendingLookups.end();)
+    {
+        bool loaded { true };
+        bool scheduled { true };
+
+        // Themes trimmed (see trimMemory()) after being loaded must be loaded again
+        for (const auto &theme : it->themes)
+        {
+            if (theme->initialized())
+                continue;
+
+            loaded = false;
+            scheduled &= scheduleLoad(*theme);
+        }
+
+        // If they can't, the callback is invoked anyway and the lookup completes with the loaded themes
+        if (loaded || !scheduled)
+        {
+            ready.emplace_back(std::move(it->callback));
+            it = m_pendingLookups.erase(it);
+        }
+        else
+            it++;
+    }
+
+    for (auto &callback : ready)
+        callback();
+}
+
+const XDGIcon *XDGIconThemeManager::findSymbolicIcon(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findSymbolicIconImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+const XDGIcon *XDGIconThemeManager::findSymbolicIcon(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findSymbolicIconImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+template <class Themes>
+const XDGIcon *XDGIconThemeManager::findSymbolicIconImpl(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    if (icon.ends_with(XDGIcon::SymbolicSuffix))
+        icon.remove_suffix(XDGIcon::SymbolicSuffix.size());
+
+    // Icon names are short, for longer ones the symbolic name isn't built and only the regular icon (without suffix) is searched
+    char symbolicName[256];
+
+    if (icon.size() + XDGIcon::SymbolicSuffix.size() > sizeof(symbolicName))
+        return findIcon(icon, size, scale, extensions, themes, contexts);
+
+    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
+        reloadThemes(true);
+
+    maybeTrimMemory();
+
+    if ((extensions & (1 | 2 | 4)) == 0 || scale <= 0 || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+        return nullptr;
+
+    std::memcpy(symbolicName, icon.data(), icon.size());
+    std::memcpy(symbolicName + icon.size(), XDGIcon::SymbolicSuffix.data(), XDGIcon::SymbolicSuffix.size());
+
+    Search symbolic
+    {
+        .icon = std::string_view(symbolicName, icon.size() + XDGIcon::SymbolicSuffix.size()),
+        .size = size,
+        .scale = scale,
+        .bufferSize = size * scale,
+        .extensions = extensions,
+        .contexts = contexts,
+        .serial = ++m_searchSerial
+    };
+
+    Search regular
+    {
+        .icon = icon,
+        .size = size,
+        .scale = scale,
+        .bufferSize = size * scale,
+        .extensions = extensions,
+        .contexts = contexts,
+        .serial = symbolic.serial
+    };
+
+    const XDGIcon *found { nullptr };
+
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+            {
+                found = findSymbolicIconHelper(symbolic, regular, *T.second);
+                if (found) return found;
+            }
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it == m_themes.end())
+            continue;
+
+        found = findSymbolicIconHelper(symbolic, regular, *it->second);
+        if (found) return found;
+    }
+
+    return symbolic.bestIcon ? symbolic.bestIcon : regular.bestIcon;
+}
+
+const XDGIcon *XDGIconThemeManager::findIconFractional(std::string_view icon, int32_t size, double scale, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findIconFractionalImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+const XDGIcon *XDGIconThemeManager::findIconFractional(std::string_view icon, int32_t size, double scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findIconFractionalImpl(icon, size, scale, extensions, themes, contexts);
+}
+
+template <class Themes>
+const XDGIcon *XDGIconThemeManager::findIconFractionalImpl(std::string_view icon, int32_t size, double scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
+        reloadThemes(true);
+
+    maybeTrimMemory();
+
+    // Also rejects NaN
+    if ((extensions & (1 | 2 | 4)) == 0 || !(scale > 0.0) || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+        return nullptr;
+
+    // Clamped to keep costs from overflowing
+    const double bufferSize { std::clamp(std::round(size * scale), 0.0, 1048576.0) };
+
+    Search search
+    {
+        .icon = icon,
+        .size = size,
+        .scale = 0, // Unused, directories are ranked by buffer size
+        .bufferSize = static_cast<int32_t>(bufferSize),
+        .extensions = extensions,
+        .contexts = contexts,
+        .serial = ++m_searchSerial
+    };
+
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+                if (findIconFractionalHelper(search, *T.second))
+                    return search.bestIcon;
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it != m_themes.end() && findIconFractionalHelper(search, *it->second))
+            return search.bestIcon;
+    }
+
+    return search.bestIcon;
+}
+
+size_t XDGIconThemeManager::findIconCandidates(std::span<Candidate> candidates, std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findIconCandidatesImpl(candidates, icon, size, scale, extensions, themes, contexts);
+}
+
+size_t XDGIconThemeManager::findIconCandidates(std::span<Candidate> candidates, std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findIconCandidatesImpl(candidates, icon, size, scale, extensions, themes, contexts);
+}
+
+template <class Themes>
+size_t XDGIconThemeManager::findIconCandidatesImpl(std::span<Candidate> candidates, std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
+        reloadThemes(true);
+
+    maybeTrimMemory();
+
+    if (candidates.empty() || (extensions & (1 | 2 | 4)) == 0 || scale <= 0 || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+        return 0;
+
+    Search search
+    {
+        .icon = icon,
+        .size = size,
+        .scale = scale,
+        .bufferSize = size * scale,
+        .extensions = extensions,
+        .contexts = contexts,
+        .serial = ++m_searchSerial,
+        .results = candidates
+    };
+
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+                collectCandidates(search, *T.second);
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it != m_themes.end())
+            collectCandidates(search, *it->second);
+    }
+
+    return search.resultCount;
+}
+
+size_t XDGIconThemeManager::findIcons(std::span<const Target> targets, std::span<const XDGIcon *> icons, std::string_view icon, uint32_t extensions, std::span<const std::string_view> themes, uint32_t contexts) noexcept
+{
+    return findIconsImpl(targets, icons, icon, extensions, themes, contexts);
+}
+
+size_t XDGIconThemeManager::findIcons(std::span<const Target> targets, std::span<const XDGIcon *> icons, std::string_view icon, uint32_t extensions, const std::vector<std::string> &themes, uint32_t contexts) noexcept
+{
+    return findIconsImpl(targets, icons, icon, extensions, themes, contexts);
+}
+
+template <class Themes>
+size_t XDGIconThemeManager::findIconsImpl(std::span<const Target> targets, std::span<const XDGIcon *> icons, std::string_view icon, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept
+{
+    if (kit().options().useIconThemesCache && kit().options().autoReloadCache)
+        reloadThemes(true);
+
+    maybeTrimMemory();
+
+    const size_t count { std::min(targets.size(), icons.size()) };
+    std::fill_n(icons.begin(), count, nullptr);
+
+    if ((extensions & (1 | 2 | 4)) == 0 || themes.empty() || (contexts & XDGIconDirectory::AnyContext) == 0)
+        return 0;
+
+    size_t found { 0 };
+
+    for (size_t offset = 0; offset < count; offset += MaxTargets)
+    {
+        const size_t batchSize { std::min(MaxTargets, count - offset) };
+
+        MultiSearch search
+        {
+            .icon = icon,
+            .extensions = extensions,
+            .contexts = contexts,
+            .serial = ++m_searchSerial,
+            .targets = targets.subspan(offset, batchSize),
+            .results = icons.subspan(offset, batchSize),
+            .pending = batchSize
+        };
+
+        for (size_t t = 0; t < batchSize; t++)
+        {
+            search.bestDistance[t] = std::numeric_limits<int32_t>::max();
+
+            // Same as findIcon()
+            if (search.targets[t].scale <= 0)
+            {
+                search.resolved[t] = true;
+                search.pending--;
+            }
+        }
+
+        if (search.pending != 0)
+            findIconsBatch(search, themes);
+
+        for (size_t t = 0; t < batchSize; t++)
+            found += search.results[t] != nullptr;
+    }
+
+    return found;
+}
+
+template <class Themes>
+void XDGIconThemeManager::findIconsBatch(MultiSearch &search, const Themes &themes) noexcept
+{
+    for (const auto &theme : themes)
+    {
+        if (theme.empty())
+        {
+            findAllThemes();
+
+            for (auto &T : m_themes)
+                if (findIconsHelper(search, *T.second))
+                    return;
+
+            continue;
+        }
+
+        const auto &it = findTheme(theme);
+
+        if (it != m_themes.end() && findIconsHelper(search, *it->second))
+            return;
+    }
+}
+
+void XDGIconThemeManager::assignThemeSlots() noexcept
+{
+    // Handles to reloaded or removed themes must be resolved again
+    for (auto &slot : m_themeSlots)
+    {
+        slot.theme = nullptr;
+        slot.generation++;
+    }
+
+    for (auto &theme : m_themes)
+        assignThemeSlot(*theme.second);
+}
+
+void XDGIconThemeManager::assignThemeSlot(XDGIconTheme &theme) noexcept
+{
+    const auto [it, inserted] { m_themeSlotIds.try_emplace(theme.name(), m_themeSlots.size()) };
+
+    if (inserted)
+        m_themeSlots.emplace_back();
+
+    theme.m_slot = it->second;
+    m_themeSlots[it->second].theme = &theme;
+}
+
+uint32_t XDGIconThemeManager::internHandleName(std::string_view name) noexcept
+{
+    const auto &it { m_handleNameIds.find(name) };
+
+    if (it != m_handleNameIds.end())
+        return it->second;
+
+    m_handleNames.emplace_back(name);
+    m_handleNameIds.emplace(name, m_handleNames.size() - 1);
+    return m_handleNames.size() - 1;
+}
+
+XDGIconHandle XDGIconThemeManager::makeHandle(const XDGIcon *icon) noexcept
+{
+    XDGIconHandle handle;
+
+    if (!icon)
+        return handle;
+
+    const XDGIconDirectory &dir { icon->directory() };
+    const XDGIconTheme &theme { dir.theme() };
+
+    handle.m_theme = theme.m_slot;
+    handle.m_generation = m_themeSlots[theme.m_slot].generation;
+    handle.m_directory = dir.m_order;
+    handle.m_icon = icon - dir.icons().begin();
+    handle.m_name = internHandleName(icon->name());
+    handle.m_dirName = internHandleName(dir.dirName());
+    return handle;
+}
+
+bool XDGIconThemeManager::isCurrent(const XDGIconHandle &handle) const noexcept
+{
+    return handle.valid() && m_themeSlots[handle.m_theme].generation == handle.m_generation;
+}
+
+const XDGIcon *XDGIconThemeManager::resolve(XDGIconHandle &handle) noexcept
+{
+    if (!handle.valid())
+        return nullptr;
+
+    const ThemeSlot &slot { m_themeSlots[handle.m_theme] };
+
+    if (slot.generation == handle.m_generation)
+        return &slot.theme->index().directories[handle.m_directory]->icons()[handle.m_icon];
+
+    if (slot.theme)
+    {
+        const std::string &name { m_handleNames[handle.m_name] };
+        const std::string &dirName { m_handleNames[handle.m_dirName] };
+
+        for (const auto *dir : slot.theme->index().directories)
+        {
+            if (dir->dirName() != dirName)
+                continue;
+
+            const XDGIcon *icon { dir->icons().find(name) };
+
+            if (!icon)
+                continue;
+
+            handle.m_generation = slot.generation;
+            handle.m_directory = dir->m_order;
+            handle.m_icon = icon - dir->icons().begin();
+            return icon;
+        }
+    }
+
+    handle = XDGIconHandle();
+    return nullptr;
+}
+
+void XDGIconThemeManager::maybeTrimMemory() noexcept
+{
+    if (kit().options().memoryBudget == 0 || m_searchSerial - m_lastTrimSerial < TrimInterval)
+        return;
+
+    trimMemory(kit().options().memoryBudget, m_lastTrimSerial, false);
+}
+
+size_t XDGIconThemeManager::trimMemory(size_t budget) noexcept
+{
+    return trimMemory(budget, std::numeric_limits<uint64_t>::max(), false);
+}
+
+int XDGIconThemeManager::memoryPressureFd() noexcept
+{
+    if (m_pressureFd != -1 || m_pressureFdFailed || !kit().options().monitorMemoryPressure)
+        return m_pressureFd;
+
+    const std::string &trigger { kit().options().memoryPressureTrigger };
+    m_pressureFd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if (m_pressureFd == -1)
+    {
+        m_pressureFdFailed = true;
+        XDGLog(CZWarning, CZLN, "Failed to open /proc/pressure/memory, memory pressure won't be monitored");
+        return -1;
+    }
+
+    if (write(m_pressureFd, trigger.c_str(), trigger.size() + 1) < 0)
+    {
+        m_pressureFdFailed = true;
+        XDGLog(CZWarning, CZLN, "Failed to create the PSI trigger \"{}\": {}", trigger, strerror(errno));
+        close(m_pressureFd);
+        m_pressureFd = -1;
+    }
+
+    return m_pressureFd;
+}
+
+void XDGIconThemeManager::dispatchMemoryPressure() noexcept
+{
+    // Keep the themes of the last TrimInterval searches
+    const uint64_t keepSince { m_searchSerial > TrimInterval ? m_searchSerial - TrimInterval : 0 };
+    trimMemory(0, keepSince, true);
+}
+
+size_t XDGIconThemeManager::trimMemory(size_t budget, uint64_t keepSince, bool pageOut) noexcept
+{
+    m_lastTrimSerial = m_searchSerial;
+
+    std::vector<XDGIconTheme*> loaded;
+    size_t total { 0 };
+
+    for (auto &theme : m_themes)
+    {
+        XDGIconTheme &T { *theme.second };
+
+        // Searched again since evicted, pages are faulted back in
+        if (T.m_cacheCold && T.m_searchSerial != T.m_coldSerial)
+            T.m_cacheCold = false;
+
+        const size_t usage { T.memoryUsage() };
+
+        if (usage == 0)
+            continue;
+
+        total += usage;
+        loaded.emplace_back(&T);
+    }
+
+    if (total <= budget)
+        return total;
+
+    // Least recently searched first
+    std::sort(loaded.begin(), loaded.end(), [](const auto *a, const auto *b) { return a->m_searchSerial < b->m_searchSerial; });
+
+    bool unloaded { false };
+
+    for (XDGIconTheme *theme : loaded)
+    {
+        if (total <= budget || theme->m_searchSerial > keepSince)
+            break;
+
+        const size_t usage { theme->memoryUsage() };
+        const bool usingCache { theme->usingCache() };
+
+        if (!theme->unload(pageOut))
+            continue;
+
+        total -= usage - theme->memoryUsage();
+
+        // Directories and icons were destroyed, handles must look them up again
+        if (!usingCache)
+        {
+            m_themeSlots[theme->m_slot].generation++;
+            unloaded = true;
+        }
+
+        XDGLog(CZDebug, CZLN, "Trimmed icon theme {} ({} bytes)", theme->name(), usage - theme->memoryUsage());
+    }
+
+    // Lets dispatchLoaded() schedule trimmed themes awaited by pending lookups again
+    if (unloaded && !m_pendingLookups.empty())
+    {
+        const uint64_t one { 1 };
+        if (m_loaderFd != -1 && write(m_loaderFd, &one, sizeof(one)) != sizeof(one))
+            XDGLog(CZWarning, CZLN, "Failed to signal the loader fd");
+    }
+
+    return total;
 }
 
 void XDGIconThemeManager::evictCache() noexcept
@@ -2,10 +2,21 @@
 #define XDGICONTHEMEMANAGER_H
 
 #include <CZ/XDG/XDGIconTheme.h>
+#include <CZ/XDG/XDGIconFuture.h>
+#include <CZ/XDG/XDGIconHandle.h>
 #include <CZ/XDG/XDGMap.h>
-#include <unordered_set>
+#include <CZ/XDG/XDGSizeBatch.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
 #include <vector>
+#include <sys/stat.h>
 
 /**
  * @brief Utility for finding icons.
@@ -42,6 +53,10 @@ public:
     /**
      * @brief Retrieves all discovered icon themes.
      *
+     * If `XDGKit::Options::themes` is set, only the allowlisted themes, their inherited themes and
+     * themes searched by name so far are included, until a lookup uses the "" placeholder.
+     * With `XDGKit::Options::backgroundInit`, only the themes searched by name so far are included until then.
+     *
      * @return A constant reference to a map where the key is the theme's
      *         directory basename (e.g. "Adwaita"), and the value is the corresponding XDGIconTheme object.
      */
@@ -51,26 +66,50 @@ public:
     }
 
     /**
-     * @brief Reloads all available themes.
+     * @brief Reloads the themes that changed.
      *
-     * Scans the system and reloads all detected themes, replacing any previously loaded data.
+     * Scans the search directories again, loads new themes and replaces the themes whose sources changed:
+     * the theme directories, index.theme, the cache file or, for themes loaded without cache, the listed directories.
+     * Unchanged themes are kept along with their cache mappings, so the cost is proportional to the changes.
      *
      * Use this function when the set of themes has changed (e.g., after installation or removal).
      *
-     * @warning All existing references to themes, theme directories, and icons will be invalidated after this call.
+     * @warning References to replaced or removed themes, their directories and icons are invalidated after this call.
+     *          Use XDGIconHandle to keep references to icons across reloads.
      *
      * @param onlyIfCacheChanged If `true`, themes will only be reloaded if a change in the cache is detected.
      *
-     * @return `true` if themes were reloaded, `false` otherwise.
+     * Registered XDGIconManifest instances are resolved again and notified of the entries whose result changed.
+     *
+     * @return `true` if any theme was added, replaced or removed, `false` otherwise.
      */
     bool reloadThemes(bool onlyIfCacheChanged = false) noexcept;
 
+    /**
+     * @brief Number of times themes have been reloaded.
+     *
+     * Incremented each time `reloadThemes()` adds, replaces or removes themes. Objects holding references to themes,
+     * directories or icons (e.g. XDGIconQuery) compare it to detect when they must be rebuilt.
+     */
+    uint64_t generation() const noexcept
+    {
+        return m_generation;
+    }
+
+    /**
+     * @brief Theme list containing only the "" placeholder (all themes), used as default by findIcon().
+     */
+    static constexpr std::string_view AnyTheme[] { "" };
+
     /**
      * @brief Searches for an icon within the specified themes.
      *
      * This function attempts to locate an icon that matches the provided criteria
      * (name, size, scale, and extensions) within the given list of themes.
      *
+     * Once the searched themes are loaded, lookups don't perform heap allocations, so names can be passed directly
+     * from `const char*` buffers (e.g. Wayland or D-Bus messages).
+     *
      * @warning It is not recommended to keep a reference to the returned icon, as it will be invalidated
      *          when `reloadThemes()` is called or when the `XDGKit` instance is removed.
      *
@@ -84,12 +123,421 @@ public:
      * @return A pointer to the closest matching icon, or `nullptr` if no match is found.
      */
     const XDGIcon *findIcon(
-        const std::string &icon,
+        std::string_view icon,
+        int32_t size, int32_t scale = 1,
+        uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+        std::span<const std::string_view> themes = AnyTheme,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon within the specified themes.
+     *
+     * Overload of findIcon() accepting a vector of theme names.
+     */
+    const XDGIcon *findIcon(
+        std::string_view icon,
+        int32_t size, int32_t scale,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Completeness of a findIconNonBlocking() result.
+     */
+    enum LookupStatus : uint32_t
+    {
+        Complete = 0, /**< All relevant themes were searched, the result is the same findIcon() would return (unless the background loader is unavailable). */
+        Partial  = 1  /**< Themes not loaded before the deadline were skipped, the result may improve once they are loaded. */
+    };
+
+    /**
+     * @brief Deadline passed to findIconNonBlocking() to never wait for themes to load.
+     */
+    static constexpr std::chrono::steady_clock::time_point NeverBlock {};
+
+    /**
+     * @brief Searches for an icon without waiting for unloaded themes past a deadline.
+     *
+     * Loading a theme without cache can take hundreds of milliseconds the first time it's searched.
+     * This variant loads unloaded themes synchronously only until the deadline is reached, later ones are skipped
+     * (their inherited themes are still searched) and queued to be loaded by a background thread.
+     *
+     * If a theme was skipped, the status is set to `Partial` and `onLoaded` is called from dispatchLoaded()
+     * once all skipped themes finish loading (or themes are reloaded), at which point querying again may yield a better icon.
+     * Skipped themes trimmed before the callback is invoked are loaded again. If the background loader can't be started
+     * (see loaderFd()), the status is `Complete` and the result only includes the themes loaded before the deadline.
+     *
+     * @param status Set to `Complete` or `Partial`.
+     * @param deadline Point in time after which unloaded themes are skipped, `NeverBlock` to skip them all.
+     * @param onLoaded Optional callback invoked from dispatchLoaded() if the status is `Partial`.
+     * @param icon The name of the icon to search for.
+     * @param size The desired nominal size of the icon.
+     * @param scale The scale factor of the icon. Defaults to 1.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     * @return A pointer to the closest matching icon among the searched themes, or `nullptr` if no match is found.
+     */
+    const XDGIcon *findIconNonBlocking(
+        LookupStatus &status,
+        std::chrono::steady_clock::time_point deadline,
+        std::function<void()> onLoaded,
+        std::string_view icon,
+        int32_t size, int32_t scale = 1,
+        uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+        std::span<const std::string_view> themes = AnyTheme,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon without waiting for unloaded themes past a deadline.
+     *
+     * Overload of findIconNonBlocking() accepting a vector of theme names.
+     */
+    const XDGIcon *findIconNonBlocking(
+        LookupStatus &status,
+        std::chrono::steady_clock::time_point deadline,
+        std::function<void()> onLoaded,
+        std::string_view icon,
+        int32_t size, int32_t scale,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon without blocking on theme loading.
+     *
+     * Returns the same icon findIcon() would, but unloaded themes are loaded by the background loader thread
+     * (see findIconNonBlocking()). If all the searched themes are already loaded, the future is resolved before returning,
+     * otherwise it's resolved from dispatchLoaded().
+     *
+     * @param icon The name of the icon to search for.
+     * @param size The desired nominal size of the icon.
+     * @param scale The scale factor of the icon. Defaults to 1.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     * @return A future resolved to the closest matching icon, or `nullptr` if no match is found.
+     */
+    XDGIconFuture findIconAsync(
+        std::string_view icon,
         int32_t size, int32_t scale = 1,
         uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
-        const std::vector<std::string> &themes = { "" },
+        std::span<const std::string_view> themes = AnyTheme,
         uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
 
+    /**
+     * @brief Searches for an icon without blocking on theme loading.
+     *
+     * Overload of findIconAsync() accepting a vector of theme names.
+     */
+    XDGIconFuture findIconAsync(
+        std::string_view icon,
+        int32_t size, int32_t scale,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief File descriptor that becomes readable when the background loader finishes loading a theme.
+     *
+     * Add it to the event loop and call dispatchLoaded() when readable.
+     *
+     * @return An eventfd, or -1 if it couldn't be created.
+     */
+    int loaderFd() noexcept;
+
+    /**
+     * @brief Invokes the findIconNonBlocking() callbacks whose themes finished loading.
+     *
+     * Must be called from the thread performing the lookups. Callbacks may perform new lookups.
+     */
+    void dispatchLoaded() noexcept;
+
+    /**
+     * @brief Searches for the symbolic variant of an icon, falling back to the regular one.
+     *
+     * Equivalent to searching for "<icon>-symbolic" and then for "<icon>" in each theme of the search order,
+     * but both names are looked up in a single traversal. The symbolic variant is preferred within a theme,
+     * so a regular icon found in a theme takes precedence over a symbolic one from a later (e.g. inherited) theme.
+     * The returned icon has the XDGIcon::Symbolic flag if it must be recolored.
+     *
+     * @param icon The name of the icon to search for, with or without the "-symbolic" suffix.
+     * @param size The desired nominal size of the icon.
+     * @param scale The scale factor of the icon. Defaults to 1.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     * @return A pointer to the closest matching icon, or `nullptr` if no match is found.
+     */
+    const XDGIcon *findSymbolicIcon(
+        std::string_view icon,
+        int32_t size, int32_t scale = 1,
+        uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+        std::span<const std::string_view> themes = AnyTheme,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for the symbolic variant of an icon, falling back to the regular one.
+     *
+     * Overload of findSymbolicIcon() accepting a vector of theme names.
+     */
+    const XDGIcon *findSymbolicIcon(
+        std::string_view icon,
+        int32_t size, int32_t scale,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon for a fractional scale factor.
+     *
+     * Intended for fractional scales (e.g. 1.25 or 1.5 from `wp_fractional_scale_v1`), where directories rarely match
+     * the requested scale exactly. Directories are ranked by the buffer size they provide (size * scale) relative to the
+     * effective buffer size `round(size * scale)`:
+     *
+     * - Directories whose range contains the buffer size are preferred and end the search.
+     * - Directories providing larger buffers (downscaled) cost the pixel difference.
+     * - Directories providing smaller buffers (upscaled, thus blurry) cost twice the pixel difference.
+     *
+     * Each theme keeps its directories sorted by buffer size (built the first time it is searched this way),
+     * so only the directories closest to the requested buffer size are checked for the icon.
+     *
+     * @param icon The name of the icon to search for.
+     * @param size The desired nominal size of the icon.
+     * @param scale The fractional scale factor, must be greater than 0.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     * @return A pointer to the closest matching icon, or `nullptr` if no match is found.
+     */
+    const XDGIcon *findIconFractional(
+        std::string_view icon,
+        int32_t size, double scale,
+        uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+        std::span<const std::string_view> themes = AnyTheme,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon for a fractional scale factor.
+     *
+     * Overload of findIconFractional() accepting a vector of theme names.
+     */
+    const XDGIcon *findIconFractional(
+        std::string_view icon,
+        int32_t size, double scale,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Icon variant returned by findIconCandidates().
+     */
+    struct Candidate
+    {
+        /**
+         * @brief The icon found.
+         */
+        const XDGIcon *icon;
+
+        /**
+         * @brief Directory containing the icon (same as `icon->directory()`).
+         */
+        const XDGIconDirectory *directory;
+
+        /**
+         * @brief Distance between the requested buffer size (size * scale) and the directory, see `XDGSizeBatch::SizeDistance()`.
+         */
+        int32_t distance;
+
+        /**
+         * @brief `true` if the directory matches the requested size and scale exactly.
+         */
+        bool exactMatch;
+    };
+
+    /**
+     * @brief Collects every variant of an icon within the specified themes, ranked from best to worst.
+     *
+     * Unlike findIcon(), the search doesn't stop at the first match: all themes in the search order and directories
+     * of any scale are visited once. Candidates are ranked first by exact match, then by distance and finally by the order
+     * in which findIcon() visits them.
+     *
+     * Results are written into the provided buffer. If more candidates than its capacity are found, only the best ones are kept.
+     * No heap allocations are performed once the searched themes are loaded.
+     *
+     * @param candidates Buffer where ranked candidates are stored.
+     * @param icon The name of the icon to search for.
+     * @param size The desired nominal size of the icon.
+     * @param scale The scale factor of the icon. Defaults to 1.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     * @return The number of candidates written to the buffer.
+     */
+    size_t findIconCandidates(
+        std::span<Candidate> candidates,
+        std::string_view icon,
+        int32_t size, int32_t scale = 1,
+        uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+        std::span<const std::string_view> themes = AnyTheme,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Collects every variant of an icon within the specified themes, ranked from best to worst.
+     *
+     * Overload of findIconCandidates() accepting a vector of theme names.
+     */
+    size_t findIconCandidates(
+        std::span<Candidate> candidates,
+        std::string_view icon,
+        int32_t size, int32_t scale,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Size and scale pair used by findIcons().
+     */
+    struct Target
+    {
+        /**
+         * @brief The desired nominal size of the icon.
+         */
+        int32_t size;
+
+        /**
+         * @brief The scale factor of the icon.
+         */
+        int32_t scale { 1 };
+    };
+
+    /**
+     * @brief Maximum number of targets resolved by findIcons() in a single traversal.
+     *
+     * Larger target lists are resolved in multiple traversals.
+     */
+    static constexpr size_t MaxTargets { 16 };
+
+    /**
+     * @brief Searches for an icon at multiple sizes and scales at once.
+     *
+     * Useful for outputs with different scale factors. The result for each target is the same findIcon() would return,
+     * but themes and directories are traversed only once, and only until every target is resolved.
+     *
+     * @param targets The requested (size, scale) pairs.
+     * @param icons Buffer where the icon found for each target is stored (`nullptr` if not found).
+     *              Only the first `min(targets.size(), icons.size())` targets are resolved.
+     * @param icon The name of the icon to search for.
+     * @param extensions Flags indicating the acceptable image file extensions.
+     * @param themes A list of theme names to search, in the specified order.
+     *               An empty string ("") serves as a placeholder to search in all themes available.
+     * @param contexts Flags to limit the search to the given XDGIconDirectory::Context (s).
+     * @return The number of targets for which an icon was found.
+     */
+    size_t findIcons(
+        std::span<const Target> targets,
+        std::span<const XDGIcon*> icons,
+        std::string_view icon,
+        uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG,
+        std::span<const std::string_view> themes = AnyTheme,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Searches for an icon at multiple sizes and scales at once.
+     *
+     * Overload of findIcons() accepting a vector of theme names.
+     */
+    size_t findIcons(
+        std::span<const Target> targets,
+        std::span<const XDGIcon*> icons,
+        std::string_view icon,
+        uint32_t extensions,
+        const std::vector<std::string> &themes,
+        uint32_t contexts = XDGIconDirectory::AnyContext) noexcept;
+
+    /**
+     * @brief Creates a handle to an icon that remains usable after themes are reloaded.
+     *
+     * The icon and directory names are interned the first time they are used in a handle,
+     * later calls don't allocate.
+     *
+     * @param icon An icon returned by this manager, or `nullptr`.
+     * @return A handle to the icon, or an invalid handle if `icon` is `nullptr`.
+     */
+    XDGIconHandle makeHandle(const XDGIcon *icon) noexcept;
+
+    /**
+     * @brief Checks in O(1) whether a handle can be resolved without a lookup.
+     *
+     * @return `true` if the handle is valid and its theme hasn't been reloaded since it was created or last resolved.
+     */
+    bool isCurrent(const XDGIconHandle &handle) const noexcept;
+
+    /**
+     * @brief Retrieves the icon referenced by a handle.
+     *
+     * O(1) if isCurrent() is `true`. Otherwise the icon is looked up by name in the directory with the same
+     * name of the reloaded theme and the handle is updated, or invalidated if it can't be found.
+     *
+     * @return The icon or `nullptr` if the handle is (or became) invalid.
+     */
+    const XDGIcon *resolve(XDGIconHandle &handle) noexcept;
+
+    /**
+     * @brief Starts reading icon files into the page cache in the background.
+     *
+     * Avoids stalling on cold reads when the icons are first drawn. The files of the given icons are grouped
+     * by directory and `posix_fadvise(POSIX_FADV_WILLNEED)` is issued for each one from the background loader thread.
+     * Returns immediately, theme loads queued by findIconNonBlocking() take precedence.
+     *
+     * @param icons Icons to prefetch, `nullptr` entries are ignored.
+     * @param extensions Flags indicating which of the icon files to prefetch.
+     */
+    void prefetch(std::span<const XDGIcon * const> icons, uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG) noexcept;
+
+    /**
+     * @brief Starts reading icon files into the page cache in the background.
+     *
+     * Overload of prefetch() accepting handles, which are resolved first (see resolve()).
+     */
+    void prefetch(std::span<XDGIconHandle> handles, uint32_t extensions = XDGIcon::PNG | XDGIcon::SVG) noexcept;
+
+    /**
+     * @brief Trims the least recently searched themes until their estimated memory usage fits the budget.
+     *
+     * Called automatically during lookups if `XDGKit::Options::memoryBudget` is set, see its documentation.
+     * Unlike automatic trimming, recently searched themes aren't spared.
+     *
+     * @param budget Memory budget in bytes.
+     * @return Estimated memory used by the loaded themes after trimming, see XDGIconTheme::memoryUsage().
+     */
+    size_t trimMemory(size_t budget) noexcept;
+
+    /**
+     * @brief Pollable file descriptor signaling memory pressure, see `XDGKit::Options::monitorMemoryPressure`.
+     *
+     * A PSI trigger on `/proc/pressure/memory`, created the first time this function is called.
+     * Add it to the event loop waiting for `POLLPRI` (`EPOLLPRI`) and call dispatchMemoryPressure() when signaled.
+     *
+     * @return The file descriptor or -1 if monitoring is disabled or not supported.
+     */
+    int memoryPressureFd() noexcept;
+
+    /**
+     * @brief Releases memory of themes not searched recently.
+     *
+     * Cached themes have their mappings paged out (`MADV_PAGEOUT`) and themes without cache drop their directories,
+     * which are rebuilt when searched again. Themes searched within the last few lookups are kept.
+     *
+     * @warning Icons and directories of trimmed themes without cache are invalidated, use XDGIconHandle to keep references.
+     */
+    void dispatchMemoryPressure() noexcept;
+
     /**
      * @brief Suggests to the OS to evict all mapped cache files from memory.
      *
@@ -100,30 +548,204 @@ public:
 private:
     struct Search
     {
-        std::string icon;
-        bool inserted { false };
+        std::string_view icon;
         int32_t size;
         int32_t scale;
         int32_t bufferSize;
         uint32_t extensions;
         uint32_t contexts;
-        std::vector<std::shared_ptr<XDGIconTheme>> themes;
-        std::unordered_set<std::shared_ptr<XDGIconTheme>> visitedThemes;
+
+        // Themes whose XDGIconTheme::m_searchSerial matches were already visited
+        uint64_t serial;
         int32_t bestDistance { std::numeric_limits<int32_t>::max() };
         const XDGIcon *bestIcon { nullptr };
+
+        // Directories containing the icon, scored in batches
+        XDGSizeBatch candidates {};
+        const XDGIcon *candidateIcons[XDGSizeBatch::Capacity] {};
+
+        // Output of findIconCandidates()
+        std::span<Candidate> results {};
+        size_t resultCount { 0 };
+
+        // Set by findIconNonBlocking(), unloaded themes are skipped past the deadline
+        std::vector<XDGIconTheme*> *skipped { nullptr };
+        std::chrono::steady_clock::time_point deadline {};
+    };
+    struct MultiSearch
+    {
+        std::string_view icon;
+        uint32_t extensions;
+        uint32_t contexts;
+        uint64_t serial;
+
+        // Per target state, a target is resolved once an exact match or SVG is found
+        std::span<const Target> targets;
+        std::span<const XDGIcon*> results;
+        size_t pending;
+        int32_t bestDistance[MaxTargets] {};
+        bool resolved[MaxTargets] {};
+
+        XDGSizeBatch candidates {};
+        const XDGIcon *candidateIcons[XDGSizeBatch::Capacity] {};
+    };
+    // Themes are assigned a slot by name that survives reloads, see XDGIconHandle
+    struct ThemeSlot
+    {
+        XDGIconTheme *theme { nullptr };
+        uint32_t generation { 0 };
+    };
+    // findIconNonBlocking() call waiting for the background loader
+    struct PendingLookup
+    {
+        std::vector<std::shared_ptr<XDGIconTheme>> themes;
+        std::function<void()> callback;
+    };
+    // Files of a directory read ahead by prefetch()
+    struct PrefetchBatch
+    {
+        std::string dir;
+        std::vector<std::string> files;
+    };
+    // Theme parsed by the init thread, see XDGKit::Options::backgroundInit
+    struct DiscoveredTheme
+    {
+        std::shared_ptr<XDGIconTheme> theme; // nullptr if invalid or taken by loadTheme()
+        bool done { false };                 // false while being parsed
+    };
+    // Arguments of a findIconAsync() call, kept until resolved
+    struct AsyncLookup
+    {
+        std::string icon;
+        int32_t size;
+        int32_t scale;
+        uint32_t extensions;
+        std::vector<std::string> themes;
+        uint32_t contexts;
     };
     friend class XDGKit;
+    friend class XDGIconQuery;
+    friend class XDGIconManifest;
     XDGIconThemeManager(XDGKit &kit) noexcept : m_kit(kit) {}
+    ~XDGIconThemeManager();
     void restoreDefaultSearchDirs() noexcept;
     void findThemes() noexcept;
-    void sanitizeThemes() noexcept;
+    void findAllThemes() noexcept;
+    XDGIconTheme *loadTheme(std::string_view name) noexcept;
+    void discoverThemes() noexcept;
+    bool takeDiscoveredTheme(std::string_view name, std::shared_ptr<XDGIconTheme> &theme) noexcept;
+    bool mergeDiscoveredThemes() noexcept;
+    void stopDiscovery() noexcept;
+    void notifyManifests() noexcept;
+    void findThemeDirs(std::string_view name, std::vector<std::filesystem::path> &dirs, std::filesystem::path &indexFilePath) const noexcept;
+    XDGMap<std::string, std::shared_ptr<XDGIconTheme>>::iterator findTheme(std::string_view name) noexcept;
+    bool initTheme(XDGIconTheme &theme) noexcept;
+    void resolveInherits(XDGIconTheme &theme) noexcept;
     void updateCacheSerial();
-    const XDGIcon *findIconHelper(Search &search, std::shared_ptr<XDGIconTheme> theme) const noexcept;
-    bool directoryMatchesSize(Search &search, const XDGIconDirectory &dir) const noexcept;
+    template <class Themes>
+    const XDGIcon *findIconImpl(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    const XDGIcon *findIconHelper(Search &search, XDGIconTheme &theme) const noexcept;
+    template <class Themes>
+    const XDGIcon *findIconNonBlockingImpl(LookupStatus &status, std::chrono::steady_clock::time_point deadline, std::function<void()> &&onLoaded,
+        std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    template <class Themes>
+    XDGIconFuture findIconAsyncImpl(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    void resolveAsync(const std::shared_ptr<XDGIconFuture::State> &state, const std::shared_ptr<AsyncLookup> &lookup) noexcept;
+    bool scheduleLoad(XDGIconTheme &theme) noexcept;
+    bool startLoader() noexcept;
+    void prefetchBatch(const PrefetchBatch &batch) noexcept;
+    void loaderMain() noexcept;
+    void stopLoader() noexcept;
+    const XDGIcon *findIconInTheme(Search &search, const XDGIconTheme &theme) const noexcept;
+    // Walks XDGIconTheme::index() once for searches sharing the size, scale and contexts (themes with more than MaxSizeClasses)
+    void findIconInIndex(std::span<Search * const> searches, const XDGIconTheme &theme, std::span<const XDGIcon*> found) const noexcept;
+    void keepClosestInTheme(Search &search, const XDGIconTheme &theme) const noexcept;
+    template <class Themes>
+    const XDGIcon *findSymbolicIconImpl(std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    const XDGIcon *findSymbolicIconHelper(Search &symbolic, Search &regular, XDGIconTheme &theme) const noexcept;
+    const XDGIcon *findSymbolicIconInTheme(Search &symbolic, Search &regular, const XDGIconTheme &theme) const noexcept;
+    template <class Themes>
+    const XDGIcon *findIconFractionalImpl(std::string_view icon, int32_t size, double scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    bool findIconFractionalHelper(Search &search, XDGIconTheme &theme) const noexcept;
+    bool findIconFractionalInTheme(Search &search, const XDGIconTheme &theme) const noexcept;
+    const XDGIcon *findIconByAvailability(Search &search, const XDGIconTheme &theme) const noexcept;
+    // Size classes of the theme containing the icon, AllSizeClasses if the theme has more than MaxSizeClasses
+    uint64_t availableSizeClasses(std::string_view icon, uint32_t extensions, uint32_t contexts, const XDGIconTheme &theme, uint64_t *svgMask = nullptr) const noexcept;
+    static bool inSizeClasses(uint64_t mask, const XDGIconDirectory &dir) noexcept
+    {
+        return mask == AllSizeClasses || ((mask >> dir.m_sizeClass) & 1) != 0;
+    }
+    // rangesMatch: buffer sizes within a Scalable or Threshold range cost 0 instead of XDGSizeBatch::SizeDistance() (findIconFractional())
+    const XDGIcon *findClosestInTheme(Search &search, const XDGIconTheme &theme, int32_t upscalePenalty, bool rangesMatch, int32_t &cost) const noexcept;
+    const XDGIcon *findIconInDirectory(Search &search, const XDGIconDirectory &dir) const noexcept;
+    template <class Themes>
+    size_t findIconCandidatesImpl(std::span<Candidate> candidates, std::string_view icon, int32_t size, int32_t scale, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    void collectCandidates(Search &search, XDGIconTheme &theme) const noexcept;
+    void collectCandidatesInTheme(Search &search, const XDGIconTheme &theme) const noexcept;
+    void rankCandidates(Search &search) const noexcept;
+    template <class Themes>
+    size_t findIconsImpl(std::span<const Target> targets, std::span<const XDGIcon*> icons, std::string_view icon, uint32_t extensions, const Themes &themes, uint32_t contexts) noexcept;
+    template <class Themes>
+    void findIconsBatch(MultiSearch &search, const Themes &themes) noexcept;
+    bool findIconsHelper(MultiSearch &search, XDGIconTheme &theme) const noexcept;
+    bool findIconsInTheme(MultiSearch &search, const XDGIconTheme &theme) const noexcept;
+    void scoreTargets(MultiSearch &search) const noexcept;
+    void maybeTrimMemory() noexcept;
+    size_t trimMemory(size_t budget, uint64_t keepSince, bool pageOut) noexcept;
+    void assignThemeSlots() noexcept;
+    void assignThemeSlot(XDGIconTheme &theme) noexcept;
+    uint32_t internHandleName(std::string_view name) noexcept;
+    void buildSearchOrder(std::span<const std::string> themes, std::vector<XDGIconTheme*> &order) noexcept;
+    void appendSearchOrder(XDGIconTheme &theme, uint64_t serial, std::vector<XDGIconTheme*> &order) noexcept;
     int32_t directorySizeDistance(Search &search, const XDGIconDirectory &dir) const noexcept;
     std::vector<std::filesystem::path> m_searchDirs;
     XDGMap<std::string, std::shared_ptr<XDGIconTheme>> m_themes;
-    std::filesystem::file_time_type m_cacheSerial;
+
+    // False while only the XDGKit::Options::themes closure is loaded, see also XDGKit::Options::backgroundInit
+    bool m_allThemesFound { false };
+
+    // Names not found by loadTheme(), to avoid scanning the search dirs again
+    XDGMap<std::string, bool> m_missingThemes;
+
+    // Themes discovered by the init thread, taken by loadTheme() or merged by findAllThemes()
+    std::mutex m_discoveryMutex;
+    std::condition_variable m_discoveryCond;
+    XDGMap<std::string, DiscoveredTheme> m_discovered;
+    bool m_discovering { false };       // Guarded by m_discoveryMutex
+    bool m_discoveryStop { false };     // Guarded by m_discoveryMutex
+    bool m_discoveryPending { false };  // Not merged yet
+    std::vector<ThemeSlot> m_themeSlots;
+    XDGMap<std::string, uint32_t> m_themeSlotIds;
+    std::vector<std::string> m_handleNames;
+    XDGMap<std::string, uint32_t> m_handleNameIds;
+    timespec m_cacheSerial {};
+    uint64_t m_searchSerial { 0 };
+    uint64_t m_generation { 0 };
+
+    // Returned by availableSizeClasses() when the theme has no availability bitmaps
+    static constexpr uint64_t AllSizeClasses { ~uint64_t(0) };
+
+    // Searches looked up together by findIconInIndex()
+    static constexpr size_t MaxIndexSearches { 2 };
+
+    // Automatic trimming runs every TrimInterval searches, see XDGKit::Options::memoryBudget
+    static constexpr uint64_t TrimInterval { 64 };
+    uint64_t m_lastTrimSerial { 0 };
+    int m_pressureFd { -1 };
+    bool m_pressureFdFailed { false };
+
+    // Background loader, started by the first findIconNonBlocking() that skips a theme or prefetch()
+    std::thread m_loaderThread;
+    std::mutex m_loaderMutex;
+    std::condition_variable m_loaderCond;
+    std::deque<std::shared_ptr<XDGIconTheme>> m_loadQueue;
+    std::deque<PrefetchBatch> m_prefetchQueue;
+    std::vector<PendingLookup> m_pendingLookups;
+
+    // Registered by XDGIconManifest, updated after each reload that changes themes
+    std::vector<XDGIconManifest*> m_manifests;
+    bool m_loaderStop { false };
+    int m_loaderFd { -1 };
     XDGKit &m_kit;
 };
 
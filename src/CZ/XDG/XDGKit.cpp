@@ -1,5 +1,6 @@
 #include <CZ/XDG/XDGKit.h>
 #include <CZ/XDG/XDGLog.h>
+#include <cerrno>
 #include <cstring>
 #include <pwd.h>
 
@@ -10,11 +11,8 @@ std::shared_ptr<XDGKit> XDGKit::Make(const Options &options) noexcept
     return std::shared_ptr<XDGKit>(new XDGKit(options));
 }
 
-void XDGKit::rescanDataDirs() noexcept
+std::string XDGKit::readDataDirsEnv() noexcept
 {
-    m_dataDirs = std::vector<std::filesystem::path>();
-    m_dataDirs.reserve(16);
-
     const char *dataDirs { getenv("XDG_DATA_DIRS") };
 
     if (!dataDirs || strlen(dataDirs) == 0)
@@ -24,9 +22,19 @@ void XDGKit::rescanDataDirs() noexcept
     }
 
     const char *env { getenv("XDG_DATA_DIRS") };
-    if (!env) return;
+    return env ? env : "";
+}
+
+void XDGKit::rescanDataDirs() noexcept
+{
+    rescanDataDirs(readDataDirsEnv());
+}
+
+void XDGKit::rescanDataDirs(const std::string &pathsString) noexcept
+{
+    m_dataDirs = std::vector<std::filesystem::path>();
+    m_dataDirs.reserve(16);
 
-    const std::string pathsString { env };
     std::istringstream stream { pathsString };
     std::string found;
 
@@ -43,18 +51,74 @@ XDGKit::XDGKit(const Options &options) noexcept :
     m_options(options),
     m_iconThemeManager(*this)
 {
+    // getenv() and setenv() aren't thread safe, the environment is only read here
+    const std::string dataDirs { readDataDirsEnv() };
+
+    if (options.backgroundInit)
+    {
+        m_iconThemeManager.m_discovering = true;
+        m_iconThemeManager.m_discoveryPending = true;
+
+        try
+        {
+            m_initThread = std::thread(&XDGKit::init, this, dataDirs, true);
+            return;
+        }
+        catch (const std::exception &e)
+        {
+            m_iconThemeManager.m_discovering = false;
+            m_iconThemeManager.m_discoveryPending = false;
+            XDGLog(CZWarning, CZLN, "Failed to start the init thread, initializing synchronously: {}", e.what());
+        }
+    }
+
+    init(dataDirs, false);
+}
+
+XDGKit::~XDGKit()
+{
+    if (m_initThread.joinable())
+    {
+        m_iconThemeManager.stopDiscovery();
+        m_initThread.join();
+    }
+}
+
+void XDGKit::init(const std::string &dataDirs, bool background) noexcept
+{
+    // May run in the init thread, accessors would wait on it
     initHomeDir();
-    rescanDataDirs();
-    iconThemeManager().restoreDefaultSearchDirs();
-    iconThemeManager().findThemes();
-    iconThemeManager().updateCacheSerial();
+    rescanDataDirs(dataDirs);
+    m_iconThemeManager.restoreDefaultSearchDirs();
+    m_iconThemeManager.updateCacheSerial();
+
+    if (!background)
+        m_iconThemeManager.findThemes();
+
+    {
+        std::lock_guard<std::mutex> lock { m_initMutex };
+        m_initialized.store(true, std::memory_order_release);
+    }
+
+    m_initCond.notify_all();
+
+    // Lookups only wait for the themes they search, see XDGIconThemeManager::loadTheme()
+    if (background)
+        m_iconThemeManager.discoverThemes();
 }
 
 void XDGKit::initHomeDir() noexcept
 {
-    passwd *pw { getpwuid(geteuid()) };
+    // Reentrant version, getpwuid() results may be overwritten by other threads
+    std::vector<char> buffer(16384);
+    passwd entry;
+    passwd *pw { nullptr };
+    int ret;
+
+    while ((ret = getpwuid_r(geteuid(), &entry, buffer.data(), buffer.size(), &pw)) == ERANGE && buffer.size() < 1048576)
+        buffer.resize(buffer.size() * 2);
 
-    if (pw)
+    if (ret == 0 && pw)
     {
         if (pw->pw_name)
             m_user = pw->pw_name;
@@ -2,9 +2,14 @@
 #define XDGKIT_H
 
 #include <CZ/XDG/XDGIconThemeManager.h>
+#include <CZ/XDG/XDGIconQuery.h>
+#include <CZ/XDG/XDGIconManifest.h>
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
 #include <memory>
-#include <unordered_set>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 /**
@@ -16,6 +21,16 @@ class CZ::XDGKit
 {
 public:
 
+    /**
+     * @brief Flags controlling how icon theme cache files are mapped, see `Options::cacheMapFlags`.
+     */
+    enum CacheMapFlags : uint32_t
+    {
+        CacheMapPopulate = static_cast<uint32_t>(1) << 0, /**< Read the whole file when mapped (`MAP_POPULATE`) instead of faulting pages in while parsing. */
+        CacheMapWillNeed = static_cast<uint32_t>(1) << 1, /**< Read ahead the page aligned directory table (`MADV_WILLNEED`). */
+        CacheMapRandom   = static_cast<uint32_t>(1) << 2  /**< Disable readahead once parsed (`MADV_RANDOM`), pages evicted by the OS are faulted back individually. */
+    };
+
     /**
      * @brief Configuration options.
      */
@@ -43,12 +58,81 @@ public:
          *       To manually trigger a check, use `CZ::XDGIconThemeManager::reloadThemes(true)`.
          */
         bool autoReloadCache { true };
+
+        /**
+         * @brief How icon theme cache files are mapped, a combination of CacheMapFlags.
+         *
+         * By default pages are faulted in on demand.
+         */
+        uint32_t cacheMapFlags { 0 };
+
+        /**
+         * @brief Soft limit in bytes for the memory used by loaded themes, 0 for no limit.
+         *
+         * Checked periodically during lookups (or by calling `CZ::XDGIconThemeManager::trimMemory()`), when exceeded the least
+         * recently searched themes are trimmed until usage fits: cached themes have their mappings released to the OS
+         * and themes without cache drop their directories, which are rebuilt when searched again.
+         * Themes searched since the last check are never trimmed.
+         *
+         * @warning Icons and directories of trimmed themes without cache are invalidated, use XDGIconHandle to keep references.
+         */
+        size_t memoryBudget { 0 };
+
+        /**
+         * @brief Monitors memory pressure to release theme memory automatically.
+         *
+         * When `true`, `CZ::XDGIconThemeManager::memoryPressureFd()` provides a PSI trigger to add to the event loop.
+         */
+        bool monitorMemoryPressure { false };
+
+        /**
+         * @brief PSI trigger written to `/proc/pressure/memory`, see the kernel PSI documentation.
+         *
+         * The default signals when tasks stall on memory for 150ms within a 2s window
+         * (unprivileged processes require windows that are multiples of 2s).
+         */
+        std::string memoryPressureTrigger { "some 150000 2000000" };
+
+        /**
+         * @brief Releases the parsed `index.theme` of themes once they are initialized.
+         *
+         * Only the name, display name, comment, example, hidden flag and inherits are kept,
+         * `CZ::XDGIconTheme::indexData()` is empty afterwards. Themes without cache read their
+         * `index.theme` again if they have to be rebuilt after being trimmed (see `memoryBudget`).
+         *
+         * Recommended for low-memory devices.
+         */
+        bool compactThemes { false };
+
+        /**
+         * @brief Discovers icon themes in a background thread.
+         *
+         * When set to `true`, the constructor returns immediately while a background thread resolves the home dir
+         * and search directories, then parses the `index.theme` (or maps the cache) of each theme.
+         * The first call to iconThemeManager(), username(), homeDir() or dataDirs() only waits for the search directories.
+         *
+         * Lookups wait only for the themes they search: themes not reached by the thread yet are parsed by the caller,
+         * and a theme being parsed is waited for. Lookups using the "" placeholder wait for all themes to be discovered.
+         *
+         * Icon directories are still loaded lazily, see `CZ::XDGIconThemeManager::findIconNonBlocking()`.
+         */
+        bool backgroundInit { false };
+
+        /**
+         * @brief Root themes to load, empty to load all themes.
+         *
+         * When set, only these themes, their `Inherits` chain and `hicolor` are discovered and parsed.
+         * Other themes are loaded on demand when searched by name, and all themes are discovered the first time
+         * a lookup uses the "" placeholder (e.g. the default `XDGIconThemeManager::AnyTheme`).
+         */
+        std::vector<std::string> themes;
     };
 
     /**
      * @brief Creates a new instance of XDGKit.
      */
     XDGKit(const Options &options = Options()) noexcept;
+    ~XDGKit();
 
     /**
      * @brief Creates a new instance of XDGKit.
@@ -62,14 +146,26 @@ public:
      */
     XDGIconThemeManager &iconThemeManager() noexcept
     {
+        waitInit();
         return m_iconThemeManager;
     }
 
+    /**
+     * @brief Checks whether the accessors are ready, without blocking.
+     *
+     * Always `true` unless `Options::backgroundInit` is enabled. Themes may still be discovered afterwards.
+     */
+    bool initialized() const noexcept
+    {
+        return m_initialized.load(std::memory_order_acquire);
+    }
+
     /**
      * @brief Retrieves the current user's username.
      */
     const std::string &username() const noexcept
     {
+        waitInit();
         return m_user;
     }
 
@@ -78,6 +174,7 @@ public:
      */
     const std::filesystem::path &homeDir() const noexcept
     {
+        waitInit();
         return m_homeDir;
     }
 
@@ -86,6 +183,7 @@ public:
      */
     const std::vector<std::filesystem::path> &dataDirs() const noexcept
     {
+        waitInit();
         return m_dataDirs;
     }
 
@@ -102,25 +200,29 @@ private:
     friend class XDGIconThemeManager;
     friend class XDGIconTheme;
     friend class XDGIcon;
-    std::string_view saveOrGetString(const std::string &string, bool *inserted = nullptr) noexcept
+    void init(const std::string &dataDirs, bool background) noexcept;
+    void waitInit() const noexcept
     {
-        if (inserted)
-        {
-            const auto &it = m_stringPool.insert(string);
-            *inserted = it.second;
-            return it.first->c_str();
-        }
-
-        return m_stringPool.insert(string).first->c_str();
+        if (m_initialized.load(std::memory_order_acquire))
+            return;
+
+        // The init thread itself is only joined by the destructor
+        std::unique_lock<std::mutex> lock { m_initMutex };
+        m_initCond.wait(lock, [this]{ return m_initialized.load(std::memory_order_acquire); });
     }
     void initHomeDir() noexcept;
+    static std::string readDataDirsEnv() noexcept;
     void rescanDataDirs() noexcept;
+    void rescanDataDirs(const std::string &dataDirs) noexcept;
     Options m_options;
     XDGIconThemeManager m_iconThemeManager;
     std::string m_user;
     std::filesystem::path m_homeDir;
     std::vector<std::filesystem::path> m_dataDirs;
-    std::unordered_set<std::string> m_stringPool;
+    std::atomic<bool> m_initialized { false };
+    mutable std::mutex m_initMutex;
+    mutable std::condition_variable m_initCond;
+    std::thread m_initThread;
 };
 
 #endif // XDGKIT_H
@@ -1,15 +1,612 @@
 #ifndef XDGMAP_H
 #define XDGMAP_H
 
-#include <unordered_map>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace CZ
 {
     /**
-     * @brief Alias for std::unordered_map
+     * @brief Default hash used by XDGMap.
+     *
+     * Specialized for std::string and std::string_view keys so that lookups can be
+     * performed with any string-like type (e.g. `const char*`) without temporary allocations.
+     */
+    template <class Key>
+    struct XDGHash : std::hash<Key> {};
+
+    template <>
+    struct XDGHash<std::string>
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view str) const noexcept
+        {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    template <>
+    struct XDGHash<std::string_view> : XDGHash<std::string> {};
+
+    /**
+     * @brief Flat open-addressing hash map.
+     *
+     * Keys and values are stored inline in a single array of slots, and a parallel array of control
+     * bytes holds 7 bits of each key hash. Lookups compare 16 control bytes at a time (Swiss-table style),
+     * so most lookups touch a single cache line of metadata and compare only one key.
+     *
+     * The interface is a subset of std::unordered_map. If the hash is transparent, find(), contains(),
+     * emplace() and operator[] accept any key-like type (e.g. `std::string_view` or `const char*` for
+     * `std::string` keys) without constructing a temporary key.
+     *
+     * @note Unlike std::unordered_map, inserting elements may invalidate references and iterators to
+     *       other elements. Erasing only invalidates the erased element.
+     *
+     * @note Elements are moved when the map grows, so `value_type` is `std::pair<Key, T>` (keys aren't const)
+     *       and both types must be nothrow move constructible. Keys must not be modified through iterators.
      */
-    template <class Key, class T>
-    using XDGMap = std::unordered_map<Key, T>;
+    template <class Key, class T, class Hash = XDGHash<Key>, class KeyEqual = std::equal_to<>>
+    class XDGMap
+    {
+        static constexpr int8_t Empty    { -128 };
+        static constexpr int8_t Deleted  { -2 };
+        static constexpr int8_t Padding  { -1 };
+        static constexpr size_t GroupSize { 16 };
+        static constexpr size_t NotFound { ~size_t(0) };
+
+        template <class K>
+        static constexpr bool IsTransparent { requires { typename Hash::is_transparent; } && std::is_invocable_v<const Hash&, const K&> };
+
+    public:
+        using key_type = Key;
+        using mapped_type = T;
+        using value_type = std::pair<Key, T>;
+        using size_type = size_t;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+
+        template <bool Const>
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = XDGMap::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+            using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+            Iterator() noexcept = default;
+
+            // Allows iterator -> const_iterator
+            template <bool C> requires (Const && !C)
+            Iterator(const Iterator<C> &other) noexcept :
+                m_ctrl(other.m_ctrl), m_slot(other.m_slot), m_end(other.m_end) {}
+
+            reference operator*() const noexcept { return *m_slot; }
+            pointer operator->() const noexcept { return m_slot; }
+
+            Iterator &operator++() noexcept
+            {
+                ++m_ctrl;
+                ++m_slot;
+                skipFree();
+                return *this;
+            }
+
+            Iterator operator++(int) noexcept
+            {
+                Iterator tmp { *this };
+                ++(*this);
+                return tmp;
+            }
+
+            template <bool C>
+            bool operator==(const Iterator<C> &other) const noexcept { return m_ctrl == other.m_ctrl; }
+
+        private:
+            friend class XDGMap;
+            Iterator(const int8_t *ctrl, pointer slot, const int8_t *end) noexcept :
+                m_ctrl(ctrl), m_slot(slot), m_end(end) {}
+
+            void skipFree() noexcept
+            {
+                while (m_ctrl != m_end && *m_ctrl < 0)
+                {
+                    ++m_ctrl;
+                    ++m_slot;
+                }
+            }
+
+            template <bool>
+            friend class Iterator;
+            const int8_t *m_ctrl { nullptr };
+            pointer m_slot { nullptr };
+            const int8_t *m_end { nullptr };
+        };
+
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        XDGMap() noexcept = default;
+
+        XDGMap(const XDGMap &other)
+        {
+            if (other.m_size == 0)
+                return;
+
+            // Built into a local map, if copying an element throws it destroys the copied ones and frees the table
+            XDGMap copy;
+            copy.allocate(other.m_capacity);
+
+            for (size_t i = 0; i < other.m_capacity; i++)
+            {
+                if (other.m_ctrl[i] < 0)
+                    continue;
+
+                std::construct_at(copy.m_slots + i, other.m_slots[i]);
+                copy.m_ctrl[i] = other.m_ctrl[i];
+            }
+
+            // Tombstones too, so probe sequences are the same
+            std::memcpy(copy.m_ctrl, other.m_ctrl, ctrlBytes(copy.m_capacity));
+            copy.m_size = other.m_size;
+            copy.m_growthLeft = other.m_growthLeft;
+            swap(copy);
+        }
+
+        XDGMap(XDGMap &&other) noexcept
+        {
+            swap(other);
+        }
+
+        XDGMap &operator=(const XDGMap &other)
+        {
+            if (this != &other)
+            {
+                XDGMap copy { other };
+                swap(copy);
+            }
+            return *this;
+        }
+
+        XDGMap &operator=(XDGMap &&other) noexcept
+        {
+            if (this != &other)
+            {
+                destroy();
+                swap(other);
+            }
+            return *this;
+        }
+
+        ~XDGMap()
+        {
+            destroy();
+        }
+
+        void swap(XDGMap &other) noexcept
+        {
+            std::swap(m_slots, other.m_slots);
+            std::swap(m_ctrl, other.m_ctrl);
+            std::swap(m_capacity, other.m_capacity);
+            std::swap(m_size, other.m_size);
+            std::swap(m_growthLeft, other.m_growthLeft);
+        }
+
+        iterator begin() noexcept { iterator it { m_ctrl, m_slots, m_ctrl + m_capacity }; it.skipFree(); return it; }
+        const_iterator begin() const noexcept { const_iterator it { m_ctrl, m_slots, m_ctrl + m_capacity }; it.skipFree(); return it; }
+        const_iterator cbegin() const noexcept { return begin(); }
+        iterator end() noexcept { return { m_ctrl + m_capacity, m_slots + m_capacity, m_ctrl + m_capacity }; }
+        const_iterator end() const noexcept { return { m_ctrl + m_capacity, m_slots + m_capacity, m_ctrl + m_capacity }; }
+        const_iterator cend() const noexcept { return end(); }
+
+        size_t size() const noexcept { return m_size; }
+        bool empty() const noexcept { return m_size == 0; }
+
+        /**
+         * @brief Number of slots currently allocated.
+         */
+        size_t capacity() const noexcept { return m_capacity; }
+
+        void clear() noexcept
+        {
+            destroy();
+        }
+
+        void reserve(size_t count)
+        {
+            const size_t capacity { capacityFor(count) };
+
+            if (capacity > m_capacity)
+                rehash(capacity);
+        }
+
+        iterator find(const Key &key) noexcept { return iteratorAt(findIndex(key)); }
+        const_iterator find(const Key &key) const noexcept { return iteratorAt(findIndex(key)); }
+
+        template <class K> requires IsTransparent<K>
+        iterator find(const K &key) noexcept { return iteratorAt(findIndex(key)); }
+
+        template <class K> requires IsTransparent<K>
+        const_iterator find(const K &key) const noexcept { return iteratorAt(findIndex(key)); }
+
+        bool contains(const Key &key) const noexcept { return findIndex(key) != NotFound; }
+
+        template <class K> requires IsTransparent<K>
+        bool contains(const K &key) const noexcept { return findIndex(key) != NotFound; }
+
+        size_t count(const Key &key) const noexcept { return contains(key) ? 1 : 0; }
+
+        template <class K> requires IsTransparent<K>
+        size_t count(const K &key) const noexcept { return contains(key) ? 1 : 0; }
+
+        T &at(const Key &key)
+        {
+            const size_t i { findIndex(key) };
+            if (i == NotFound) throw std::out_of_range("XDGMap::at");
+            return m_slots[i].second;
+        }
+
+        const T &at(const Key &key) const
+        {
+            const size_t i { findIndex(key) };
+            if (i == NotFound) throw std::out_of_range("XDGMap::at");
+            return m_slots[i].second;
+        }
+
+        T &operator[](const Key &key) { return try_emplace(key).first->second; }
+        T &operator[](Key &&key) { return try_emplace(std::move(key)).first->second; }
+
+        template <class K> requires (IsTransparent<K> && !std::same_as<std::remove_cvref_t<K>, Key> && std::constructible_from<Key, K>)
+        T &operator[](K &&key) { return try_emplace(std::forward<K>(key)).first->second; }
+
+        /**
+         * @brief Inserts an element constructed from the given key and mapped value arguments if the key doesn't exist.
+         */
+        template <class K, class... Args>
+        std::pair<iterator, bool> try_emplace(K &&key, Args&&... args)
+        {
+            if constexpr (IsTransparent<K> || std::same_as<std::remove_cvref_t<K>, Key>)
+            {
+                const uint64_t hash { hashOf(key) };
+                size_t i { findIndex(key, hash) };
+
+                if (i != NotFound)
+                    return { iteratorAt(i), false };
+
+                // The slot is only marked as used once constructed, in case the constructor throws
+                i = prepareInsert(hash);
+                std::construct_at(m_slots + i, std::piecewise_construct,
+                    std::forward_as_tuple(std::forward<K>(key)),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+                setUsed(i, hash);
+                return { iteratorAt(i), true };
+            }
+            else
+            {
+                Key tmp(std::forward<K>(key));
+                return try_emplace(std::move(tmp), std::forward<Args>(args)...);
+            }
+        }
+
+        template <class K, class... Args>
+        std::pair<iterator, bool> emplace(K &&key, Args&&... args)
+        {
+            return try_emplace(std::forward<K>(key), std::forward<Args>(args)...);
+        }
+
+        std::pair<iterator, bool> insert(const value_type &value)
+        {
+            return try_emplace(value.first, value.second);
+        }
+
+        std::pair<iterator, bool> insert(value_type &&value)
+        {
+            return try_emplace(std::move(value.first), std::move(value.second));
+        }
+
+        /**
+         * @brief Erases the element at the given position.
+         *
+         * @return An iterator to the next element.
+         */
+        iterator erase(const_iterator pos) noexcept
+        {
+            const size_t i { static_cast<size_t>(pos.m_ctrl - m_ctrl) };
+            eraseIndex(i);
+            iterator it { iteratorAt(i) };
+            it.skipFree();
+            return it;
+        }
+
+        iterator erase(iterator pos) noexcept
+        {
+            return erase(const_iterator(pos));
+        }
+
+        size_t erase(const Key &key) noexcept { return eraseKey(key); }
+
+        template <class K> requires IsTransparent<K>
+        size_t erase(const K &key) noexcept { return eraseKey(key); }
+
+        /**
+         * @brief Slot index of an element.
+         *
+         * Remains valid until the map is modified.
+         */
+        size_t slotOf(const_iterator pos) const noexcept
+        {
+            return static_cast<size_t>(pos.m_ctrl - m_ctrl);
+        }
+
+        /**
+         * @brief Iterator to the element stored in the given slot (see slotOf()).
+         *
+         * @return The element or end() if the slot is out of range or free.
+         */
+        const_iterator atSlot(size_t slot) const noexcept
+        {
+            if (slot >= m_capacity || m_ctrl[slot] < 0)
+                return end();
+
+            return iteratorAt(slot);
+        }
+
+    private:
+        template <class K>
+        static uint64_t hashOf(const K &key) noexcept
+        {
+            // fmix64, spreads low entropy std::hash outputs across all bits
+            uint64_t h { static_cast<uint64_t>(Hash{}(key)) };
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+        static int8_t h2(uint64_t hash) noexcept { return static_cast<int8_t>(hash & 0x7F); }
+
+        static uint32_t match(const int8_t *group, int8_t value) noexcept
+        {
+#ifdef __SSE2__
+            const __m128i ctrl { _mm_loadu_si128(reinterpret_cast<const __m128i*>(group)) };
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value))));
+#else
+            uint32_t mask { 0 };
+            for (size_t i = 0; i < GroupSize; i++)
+                mask |= static_cast<uint32_t>(group[i] == value) << i;
+            return mask;
+#endif
+        }
+
+        // Empty or deleted slots
+        static uint32_t matchFree(const int8_t *group) noexcept
+        {
+            return match(group, Empty) | match(group, Deleted);
+        }
+
+        static size_t ctrlBytes(size_t capacity) noexcept
+        {
+            return capacity < GroupSize ? GroupSize : capacity;
+        }
+
+        static size_t maxLoad(size_t capacity) noexcept
+        {
+            return capacity < GroupSize ? capacity - 1 : capacity - capacity / 8;
+        }
+
+        static size_t capacityFor(size_t count) noexcept
+        {
+            if (count == 0)
+                return 0;
+
+            size_t capacity { 4 };
+
+            while (maxLoad(capacity) < count)
+                capacity *= 2;
+
+            return capacity;
+        }
+
+        size_t groupMask() const noexcept
+        {
+            return m_capacity < GroupSize ? 0 : m_capacity / GroupSize - 1;
+        }
+
+        template <class K>
+        size_t findIndex(const K &key) const noexcept
+        {
+            return m_size == 0 ? NotFound : findIndex(key, hashOf(key));
+        }
+
+        template <class K>
+        size_t findIndex(const K &key, uint64_t hash) const noexcept
+        {
+            if (m_capacity == 0)
+                return NotFound;
+
+            const size_t mask { groupMask() };
+            const int8_t tag { h2(hash) };
+            size_t group { (hash >> 7) & mask };
+
+            for (size_t step = 0; step <= mask; step++)
+            {
+                const int8_t *ctrl { m_ctrl + group * GroupSize };
+
+                for (uint32_t bits = match(ctrl, tag); bits != 0; bits &= bits - 1)
+                {
+                    const size_t i { group * GroupSize + std::countr_zero(bits) };
+
+                    if (KeyEqual{}(m_slots[i].first, key))
+                        return i;
+                }
+
+                if (match(ctrl, Empty) != 0)
+                    return NotFound;
+
+                group = (group + step + 1) & mask;
+            }
+
+            return NotFound;
+        }
+
+        // Finds a free slot for a key known to be absent, growing the table if needed (see setUsed())
+        size_t prepareInsert(uint64_t hash)
+        {
+            if (m_growthLeft == 0)
+            {
+                // Reuse the current capacity if most of the used slots are tombstones
+                if (m_capacity >= GroupSize && m_size <= maxLoad(m_capacity) / 2)
+                    rehash(m_capacity);
+                else
+                    rehash(std::max(capacityFor(m_size + 1), m_capacity * 2));
+            }
+
+            return findFree(hash);
+        }
+
+        size_t findFree(uint64_t hash) const noexcept
+        {
+            const size_t mask { groupMask() };
+            size_t group { (hash >> 7) & mask };
+            size_t step { 0 };
+            uint32_t bits;
+
+            while ((bits = matchFree(m_ctrl + group * GroupSize)) == 0)
+                group = (group + ++step) & mask;
+
+            return group * GroupSize + std::countr_zero(bits);
+        }
+
+        // Marks a slot returned by prepareInsert() as used, once the element is constructed
+        void setUsed(size_t i, uint64_t hash) noexcept
+        {
+            if (m_ctrl[i] == Empty)
+                m_growthLeft--;
+
+            m_ctrl[i] = h2(hash);
+            m_size++;
+        }
+
+        template <class K>
+        size_t eraseKey(const K &key) noexcept
+        {
+            const size_t i { findIndex(key) };
+
+            if (i == NotFound)
+                return 0;
+
+            eraseIndex(i);
+            return 1;
+        }
+
+        void eraseIndex(size_t i) noexcept
+        {
+            std::destroy_at(m_slots + i);
+            m_size--;
+
+            // Lookups stop at groups with empty slots, so the slot can be reused
+            if (match(m_ctrl + (i / GroupSize) * GroupSize, Empty) != 0)
+            {
+                m_ctrl[i] = Empty;
+                m_growthLeft++;
+            }
+            else
+                m_ctrl[i] = Deleted;
+        }
+
+        void allocate(size_t capacity)
+        {
+            // Slots and control bytes share a single allocation
+            const size_t ctrlSlots { (ctrlBytes(capacity) + sizeof(value_type) - 1) / sizeof(value_type) };
+            m_slots = std::allocator<value_type>().allocate(capacity + ctrlSlots);
+            m_ctrl = reinterpret_cast<int8_t*>(m_slots + capacity);
+            m_capacity = capacity;
+            std::memset(m_ctrl, Empty, capacity);
+            std::memset(m_ctrl + capacity, Padding, ctrlBytes(capacity) - capacity);
+            m_growthLeft = maxLoad(capacity);
+            m_size = 0;
+        }
+
+        void deallocate() noexcept
+        {
+            if (!m_slots)
+                return;
+
+            const size_t ctrlSlots { (ctrlBytes(m_capacity) + sizeof(value_type) - 1) / sizeof(value_type) };
+            std::allocator<value_type>().deallocate(m_slots, m_capacity + ctrlSlots);
+            m_slots = nullptr;
+            m_ctrl = nullptr;
+            m_capacity = m_size = m_growthLeft = 0;
+        }
+
+        void destroy() noexcept
+        {
+            if constexpr (!std::is_trivially_destructible_v<value_type>)
+                for (size_t i = 0; i < m_capacity; i++)
+                    if (m_ctrl[i] >= 0)
+                        std::destroy_at(m_slots + i);
+
+            deallocate();
+        }
+
+        void rehash(size_t capacity)
+        {
+            static_assert(std::is_nothrow_move_constructible_v<value_type>, "XDGMap elements must be nothrow move constructible");
+
+            // Allocated before touching the current table, if it throws the map is left unchanged
+            XDGMap next;
+            next.allocate(capacity);
+
+            for (size_t i = 0; i < m_capacity; i++)
+            {
+                if (m_ctrl[i] < 0)
+                    continue;
+
+                const uint64_t hash { hashOf(m_slots[i].first) };
+                const size_t j { next.findFree(hash) };
+                std::construct_at(next.m_slots + j, std::move(m_slots[i]));
+                next.setUsed(j, hash);
+                std::destroy_at(m_slots + i);
+            }
+
+            // Elements were already destroyed
+            deallocate();
+            swap(next);
+        }
+
+        iterator iteratorAt(size_t i) noexcept
+        {
+            return i == NotFound ? end() : iterator { m_ctrl + i, m_slots + i, m_ctrl + m_capacity };
+        }
+
+        const_iterator iteratorAt(size_t i) const noexcept
+        {
+            return i == NotFound ? end() : const_iterator { m_ctrl + i, m_slots + i, m_ctrl + m_capacity };
+        }
+
+        value_type *m_slots { nullptr };
+        int8_t *m_ctrl { nullptr };
+        size_t m_capacity { 0 };
+        size_t m_size { 0 };
+        size_t m_growthLeft { 0 };
+    };
 }
 
 #endif // XDGMAP_H
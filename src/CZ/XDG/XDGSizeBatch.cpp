@@ -0,0 +1,249 @@
+#include <CZ/XDG/XDGSizeBatch.h>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CZ_XDG_SIZE_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace CZ;
+
+// Returned for directories whose distance can't be computed (or when the buffer size is within a non-fixed range)
+static constexpr int32_t NoDistance { std::numeric_limits<int32_t>::max() - 1 };
+
+bool XDGSizeBatch::MatchesSize(const XDGIconDirectory::Cache &dir, int32_t size, int32_t scale) noexcept
+{
+    if (scale != dir.scale)
+        return false;
+
+    if (dir.sizeType == XDGIconDirectory::SizeType::Fixed)
+        return size == dir.size;
+    else if (dir.sizeType == XDGIconDirectory::SizeType::Scalable)
+        return dir.minSize <= size &&  size <= dir.maxSize;
+    else if (dir.sizeType == XDGIconDirectory::SizeType::Threshold)
+        return dir.size - dir.threshold <= size && size <= dir.size + dir.threshold;
+
+    return false;
+}
+
+int32_t XDGSizeBatch::SizeDistance(const XDGIconDirectory::Cache &dir, int32_t bufferSize) noexcept
+{
+    if (dir.sizeType == XDGIconDirectory::SizeType::Fixed)
+        return std::abs(bufferSize - dir.size * dir.scale);
+    else if (dir.sizeType == XDGIconDirectory::SizeType::Scalable)
+    {
+        if (bufferSize < dir.minSize * dir.scale)
+            return dir.minSize * dir.scale - bufferSize;
+        else if (bufferSize > dir.maxSize * dir.scale)
+            return bufferSize - dir.maxSize * dir.scale;
+    }
+    else if (dir.sizeType == XDGIconDirectory::SizeType::Threshold)
+    {
+        if (bufferSize < (dir.size - dir.threshold) * dir.scale)
+            return (dir.size - dir.threshold) * dir.scale - bufferSize;
+        else if (bufferSize > (dir.maxSize + dir.threshold) * dir.scale)
+            return bufferSize - (dir.maxSize + dir.threshold) * dir.scale;
+    }
+
+    return NoDistance;
+}
+
+namespace CZ
+{
+struct XDGSizeBatchKernels
+{
+    static void scalar(XDGSizeBatch &b, uint32_t from, int32_t size, int32_t scale) noexcept
+    {
+        XDGIconDirectory::Cache dir;
+        const int32_t bufferSize { size * scale };
+
+        for (uint32_t i = from; i < b.m_count; i++)
+        {
+            dir.sizeType = (XDGIconDirectory::SizeType)b.m_sizeType[i];
+            dir.size = b.m_size[i];
+            dir.minSize = b.m_minSize[i];
+            dir.maxSize = b.m_maxSize[i];
+            dir.scale = b.m_scale[i];
+            dir.threshold = b.m_threshold[i];
+            b.m_matches[i] = XDGSizeBatch::MatchesSize(dir, size, scale);
+            b.m_distances[i] = XDGSizeBatch::SizeDistance(dir, bufferSize);
+        }
+    }
+
+#ifdef CZ_XDG_SIZE_BATCH_X86
+    /*
+     * Branchless version of MatchesSize() and SizeDistance():
+     *
+     * match:    [lo, hi] = Fixed ? [size, size] : Scalable ? [min, max] : [size - th, size + th]
+     * distance: [dlo, dhi] = Fixed ? [size, size] : Scalable ? [min, max] : [size - th, max + th] (times scale)
+     *           below ? dlo - buffer : above ? buffer - dhi : (Fixed ? 0 : NoDistance)
+     */
+
+    __attribute__((target("sse4.1")))
+    static void sse41(XDGSizeBatch &b, uint32_t from, int32_t size, int32_t scale) noexcept
+    {
+        const __m128i qSize { _mm_set1_epi32(size) };
+        const __m128i qScale { _mm_set1_epi32(scale) };
+        const __m128i qBuffer { _mm_set1_epi32(size * scale) };
+        const __m128i fixedType { _mm_set1_epi32(XDGIconDirectory::Fixed) };
+        const __m128i scalableType { _mm_set1_epi32(XDGIconDirectory::Scalable) };
+        const __m128i thresholdType { _mm_set1_epi32(XDGIconDirectory::Threshold) };
+        const __m128i noDistance { _mm_set1_epi32(NoDistance) };
+        uint32_t i { from };
+
+        for (; i + 4 <= b.m_count; i += 4)
+        {
+            const __m128i type { _mm_load_si128((const __m128i*)&b.m_sizeType[i]) };
+            const __m128i dSize { _mm_load_si128((const __m128i*)&b.m_size[i]) };
+            const __m128i dMin { _mm_load_si128((const __m128i*)&b.m_minSize[i]) };
+            const __m128i dMax { _mm_load_si128((const __m128i*)&b.m_maxSize[i]) };
+            const __m128i dScale { _mm_load_si128((const __m128i*)&b.m_scale[i]) };
+            const __m128i dThreshold { _mm_load_si128((const __m128i*)&b.m_threshold[i]) };
+
+            const __m128i isFixed { _mm_cmpeq_epi32(type, fixedType) };
+            const __m128i isScalable { _mm_cmpeq_epi32(type, scalableType) };
+            const __m128i isThreshold { _mm_cmpeq_epi32(type, thresholdType) };
+            const __m128i isValid { _mm_or_si128(isFixed, _mm_or_si128(isScalable, isThreshold)) };
+
+            // Match
+            const __m128i sizeMinusTh { _mm_sub_epi32(dSize, dThreshold) };
+            __m128i lo { _mm_blendv_epi8(sizeMinusTh, dMin, isScalable) };
+            lo = _mm_blendv_epi8(lo, dSize, isFixed);
+            __m128i hi { _mm_blendv_epi8(_mm_add_epi32(dSize, dThreshold), dMax, isScalable) };
+            hi = _mm_blendv_epi8(hi, dSize, isFixed);
+
+            __m128i match { _mm_and_si128(isValid, _mm_cmpeq_epi32(dScale, qScale)) };
+            match = _mm_andnot_si128(_mm_cmpgt_epi32(lo, qSize), match);
+            match = _mm_andnot_si128(_mm_cmpgt_epi32(qSize, hi), match);
+
+            // Distance
+            const __m128i dlo { _mm_mullo_epi32(lo, dScale) };
+            __m128i dhi { _mm_blendv_epi8(_mm_add_epi32(dMax, dThreshold), dMax, isScalable) };
+            dhi = _mm_mullo_epi32(_mm_blendv_epi8(dhi, dSize, isFixed), dScale);
+
+            __m128i distance { _mm_andnot_si128(isFixed, noDistance) };
+            distance = _mm_blendv_epi8(distance, _mm_sub_epi32(qBuffer, dhi), _mm_cmpgt_epi32(qBuffer, dhi));
+            distance = _mm_blendv_epi8(distance, _mm_sub_epi32(dlo, qBuffer), _mm_cmpgt_epi32(dlo, qBuffer));
+            distance = _mm_blendv_epi8(noDistance, distance, isValid);
+
+            _mm_store_si128((__m128i*)&b.m_distances[i], distance);
+
+            const int mask { _mm_movemask_ps(_mm_castsi128_ps(match)) };
+            for (uint32_t j = 0; j < 4; j++)
+                b.m_matches[i + j] = (mask >> j) & 1;
+        }
+
+        scalar(b, i, size, scale);
+    }
+
+    __attribute__((target("avx2")))
+    static void avx2(XDGSizeBatch &b, uint32_t from, int32_t size, int32_t scale) noexcept
+    {
+        const __m256i qSize { _mm256_set1_epi32(size) };
+        const __m256i qScale { _mm256_set1_epi32(scale) };
+        const __m256i qBuffer { _mm256_set1_epi32(size * scale) };
+        const __m256i fixedType { _mm256_set1_epi32(XDGIconDirectory::Fixed) };
+        const __m256i scalableType { _mm256_set1_epi32(XDGIconDirectory::Scalable) };
+        const __m256i thresholdType { _mm256_set1_epi32(XDGIconDirectory::Threshold) };
+        const __m256i noDistance { _mm256_set1_epi32(NoDistance) };
+        uint32_t i { from };
+
+        for (; i + 8 <= b.m_count; i += 8)
+        {
+            const __m256i type { _mm256_load_si256((const __m256i*)&b.m_sizeType[i]) };
+            const __m256i dSize { _mm256_load_si256((const __m256i*)&b.m_size[i]) };
+            const __m256i dMin { _mm256_load_si256((const __m256i*)&b.m_minSize[i]) };
+            const __m256i dMax { _mm256_load_si256((const __m256i*)&b.m_maxSize[i]) };
+            const __m256i dScale { _mm256_load_si256((const __m256i*)&b.m_scale[i]) };
+            const __m256i dThreshold { _mm256_load_si256((const __m256i*)&b.m_threshold[i]) };
+
+            const __m256i isFixed { _mm256_cmpeq_epi32(type, fixedType) };
+            const __m256i isScalable { _mm256_cmpeq_epi32(type, scalableType) };
+            const __m256i isThreshold { _mm256_cmpeq_epi32(type, thresholdType) };
+            const __m256i isValid { _mm256_or_si256(isFixed, _mm256_or_si256(isScalable, isThreshold)) };
+
+            // Match
+            const __m256i sizeMinusTh { _mm256_sub_epi32(dSize, dThreshold) };
+            __m256i lo { _mm256_blendv_epi8(sizeMinusTh, dMin, isScalable) };
+            lo = _mm256_blendv_epi8(lo, dSize, isFixed);
+            __m256i hi { _mm256_blendv_epi8(_mm256_add_epi32(dSize, dThreshold), dMax, isScalable) };
+            hi = _mm256_blendv_epi8(hi, dSize, isFixed);
+
+            __m256i match { _mm256_and_si256(isValid, _mm256_cmpeq_epi32(dScale, qScale)) };
+            match = _mm256_andnot_si256(_mm256_cmpgt_epi32(lo, qSize), match);
+            match = _mm256_andnot_si256(_mm256_cmpgt_epi32(qSize, hi), match);
+
+            // Distance
+            const __m256i dlo { _mm256_mullo_epi32(lo, dScale) };
+            __m256i dhi { _mm256_blendv_epi8(_mm256_add_epi32(dMax, dThreshold), dMax, isScalable) };
+            dhi = _mm256_mullo_epi32(_mm256_blendv_epi8(dhi, dSize, isFixed), dScale);
+
+            __m256i distance { _mm256_andnot_si256(isFixed, noDistance) };
+            distance = _mm256_blendv_epi8(distance, _mm256_sub_epi32(qBuffer, dhi), _mm256_cmpgt_epi32(qBuffer, dhi));
+            distance = _mm256_blendv_epi8(distance, _mm256_sub_epi32(dlo, qBuffer), _mm256_cmpgt_epi32(dlo, qBuffer));
+            distance = _mm256_blendv_epi8(noDistance, distance, isValid);
+
+            _mm256_store_si256((__m256i*)&b.m_distances[i], distance);
+
+            const int mask { _mm256_movemask_ps(_mm256_castsi256_ps(match)) };
+            for (uint32_t j = 0; j < 8; j++)
+                b.m_matches[i + j] = (mask >> j) & 1;
+        }
+
+        sse41(b, i, size, scale);
+    }
+#endif
+};
+}
+
+static bool implSupported(XDGSizeBatch::Impl impl) noexcept
+{
+#ifdef CZ_XDG_SIZE_BATCH_X86
+    if (impl == XDGSizeBatch::AVX2)
+        return __builtin_cpu_supports("avx2");
+    else if (impl == XDGSizeBatch::SSE41)
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    return impl == XDGSizeBatch::Scalar;
+}
+
+XDGSizeBatch::Impl XDGSizeBatch::impl() noexcept
+{
+    static const Impl best
+    {
+        implSupported(AVX2) ? AVX2 :
+        implSupported(SSE41) ? SSE41 :
+        Scalar
+    };
+
+    return best;
+}
+
+void XDGSizeBatch::score(int32_t size, int32_t scale) noexcept
+{
+    run(size, scale, impl());
+}
+
+void XDGSizeBatch::score(int32_t size, int32_t scale, Impl impl) noexcept
+{
+    run(size, scale, implSupported(impl) ? impl : Scalar);
+}
+
+void XDGSizeBatch::run(int32_t size, int32_t scale, Impl impl) noexcept
+{
+    switch (impl)
+    {
+#ifdef CZ_XDG_SIZE_BATCH_X86
+    case AVX2:
+        XDGSizeBatchKernels::avx2(*this, 0, size, scale);
+        break;
+    case SSE41:
+        XDGSizeBatchKernels::sse41(*this, 0, size, scale);
+        break;
+#endif
+    default:
+        XDGSizeBatchKernels::scalar(*this, 0, size, scale);
+        break;
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef XDGSIZEBATCH_H
+#define XDGSIZEBATCH_H
+
+#include <CZ/XDG/XDGIconDirectory.h>
+#include <cstdint>
+
+/**
+ * @brief Batch of icon directories scored against a requested size in a single pass.
+ *
+ * The directory properties are stored as a structure of arrays so that match flags and
+ * size distances can be computed for many directories at once using SIMD instructions.
+ *
+ * The implementation (AVX2, SSE4.1 or scalar) is selected at runtime based on the CPU
+ * features. All implementations produce results identical to MatchesSize() and SizeDistance().
+ */
+class CZ::XDGSizeBatch
+{
+public:
+
+    /**
+     * @brief Available kernel implementations.
+     */
+    enum Impl : uint32_t
+    {
+        Scalar, /**< Portable scalar loop. */
+        SSE41,  /**< 4 directories per iteration. */
+        AVX2    /**< 8 directories per iteration. */
+    };
+
+    /**
+     * @brief Maximum number of directories a batch can hold.
+     */
+    static constexpr uint32_t Capacity { 64 };
+
+    XDGSizeBatch() noexcept {}
+
+    /**
+     * @brief Implementation used by score().
+     */
+    static Impl impl() noexcept;
+
+    /**
+     * @brief Checks if a directory matches the given nominal size and scale.
+     *
+     * Scalar reference of the match flags computed by score().
+     */
+    static bool MatchesSize(const XDGIconDirectory::Cache &dir, int32_t size, int32_t scale) noexcept;
+
+    /**
+     * @brief Distance between the given buffer size (size * scale) and the directory.
+     *
+     * `std::numeric_limits<int32_t>::max() - 1` if the buffer size is within the range of a Scalable or Threshold
+     * directory (or the size type is invalid), so those are only picked as closest size if nothing else is available.
+     *
+     * Scalar reference of the distances computed by score().
+     */
+    static int32_t SizeDistance(const XDGIconDirectory::Cache &dir, int32_t bufferSize) noexcept;
+
+    /**
+     * @brief Appends a directory to the batch.
+     *
+     * @return `false` if the batch is already full.
+     */
+    bool push(const XDGIconDirectory::Cache &dir) noexcept
+    {
+        if (m_count == Capacity)
+            return false;
+
+        m_sizeType[m_count] = dir.sizeType;
+        m_size[m_count] = dir.size;
+        m_minSize[m_count] = dir.minSize;
+        m_maxSize[m_count] = dir.maxSize;
+        m_scale[m_count] = dir.scale;
+        m_threshold[m_count] = dir.threshold;
+        m_count++;
+        return true;
+    }
+
+    /**
+     * @brief Removes all directories from the batch.
+     */
+    void clear() noexcept { m_count = 0; }
+
+    /**
+     * @brief Number of directories in the batch.
+     */
+    uint32_t size() const noexcept { return m_count; }
+
+    /**
+     * @brief Checks whether the batch is empty.
+     */
+    bool empty() const noexcept { return m_count == 0; }
+
+    /**
+     * @brief Checks whether the batch is full.
+     */
+    bool full() const noexcept { return m_count == Capacity; }
+
+    /**
+     * @brief Computes the match flags and distances of all directories using the fastest available implementation.
+     *
+     * @param size The requested nominal size.
+     * @param scale The requested scale factor.
+     */
+    void score(int32_t size, int32_t scale) noexcept;
+
+    /**
+     * @brief Same as score() but using the given implementation.
+     *
+     * Falls back to the scalar implementation if the requested one isn't supported by the CPU.
+     */
+    void score(int32_t size, int32_t scale, Impl impl) noexcept;
+
+    /**
+     * @brief Match flag of the i-th directory (valid after score()).
+     */
+    bool matches(uint32_t i) const noexcept { return m_matches[i] != 0; }
+
+    /**
+     * @brief Size distance of the i-th directory (valid after score()).
+     */
+    int32_t distance(uint32_t i) const noexcept { return m_distances[i]; }
+
+private:
+    friend struct XDGSizeBatchKernels;
+    void run(int32_t size, int32_t scale, Impl impl) noexcept;
+    alignas(32) int32_t m_sizeType[Capacity];
+    alignas(32) int32_t m_size[Capacity];
+    alignas(32) int32_t m_minSize[Capacity];
+    alignas(32) int32_t m_maxSize[Capacity];
+    alignas(32) int32_t m_scale[Capacity];
+    alignas(32) int32_t m_threshold[Capacity];
+    alignas(32) int32_t m_distances[Capacity];
+    alignas(32) uint8_t m_matches[Capacity];
+    uint32_t m_count { 0 };
+};
+
+#endif // XDGSIZEBATCH_H
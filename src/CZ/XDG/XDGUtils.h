@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <string>
+#include <sys/stat.h>
 #include <unordered_set>
 #include <vector>
 
@@ -86,6 +87,18 @@ namespace CZ
 
             return (char*)pos + size;
         }
+
+        // Modification time of a file, zero if it doesn't exist
+        inline timespec modificationTime(const char *path) noexcept
+        {
+            struct stat st;
+            return stat(path, &st) == 0 ? st.st_mtim : timespec {};
+        }
+
+        inline bool sameTime(const timespec &a, const timespec &b) noexcept
+        {
+            return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+        }
     }
 }
 
@@ -1,20 +1,22 @@
 #include <CZ/XDG/XDGKit.h>
+#include <algorithm>
 #include <cassert>
 #include <iostream>
-#include <fstream>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <pwd.h>
 
-/* THEME CACHE FORMAT
+/* THEME CACHE FORMAT (written by XDGIconTheme::writeCache())
 
+u32: magic (XDGIconTheme::CacheMagic)
+u32: version (XDGIconTheme::CacheVersion)
 str: theme name
 u64: serialized index.theme size
 str: serialized index.theme data
 u64: num directories
-FOREACH DIR:
-    bol: is scaled dir
-
+u64: directory table offset (page aligned, zero padded)
+FOREACH DIR (sorted by XDGIconTheme::DirectoryIndexLess()):
     i32: size
     i32: max size
     i32: min size
@@ -23,13 +25,23 @@ FOREACH DIR:
     u32: type
     u32: size type
     u32: context
-
+FOREACH DIR (same order):
+    u32: search order (position among scaled dirs followed by normal dirs)
+    bol: is scaled dir
     str: theme dir
     str: dir name
+    str: dir path (theme dir / dir name, see XDGIconDirectory::path())
     u64: icons num
     FOREACH ICON:
         str: icon name
-        u32: extensions
+        u32: extensions (XDGIcon::Extension flags, including XDGIcon::Symbolic)
+u64: num size classes (see XDGIconTheme::sizeClasses())
+u64: num icons (0 if there are more than XDGIconTheme::MaxSizeClasses size classes)
+FOREACH ICON:
+    str: icon name
+    u64: size classes with PNG
+    u64: size classes with SVG
+    u64: size classes with XPM
 */
 
 /* CACHE DIRS
@@ -86,9 +98,6 @@ static void saveCache(const std::string &username)
     }
 
     std::filesystem::path cacheFilePath;
-    uint64_t u64;
-    uint32_t u32;
-    bool boolean;
 
     for (auto &theme : kit->iconThemeManager().themes())
     {
@@ -97,109 +106,22 @@ static void saveCache(const std::string &username)
         if (isSystem == inHome)
             continue;
 
-        try {
-            std::cout << "    Found theme: " << theme.first << " => " << theme.second->indexFilePath().string() << "\n";
-            cacheFilePath = currentCacheDir / theme.first;
-            std::ofstream file(cacheFilePath, std::ios::binary);
-
-            if (!file)
-            {
-                std::cout << "    Failed to create cache file for theme: " << theme.first << "\n";
-                continue;
-            }
-
-            file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-
-            // Theme name
-            file.write(theme.first.c_str(), theme.first.size() + 1);
-
-            // Serialized index.theme size
-            u64 = theme.second->indexData().mapSize();
-            file.write((const char*)&u64, sizeof(u64));
-
-            // Serialized index.theme data
-            file.write((const char*)theme.second->indexData().map(), u64);
-
-            // Directories num
-            u64 = theme.second->iconDirectories().size() + theme.second->scaledIconDirectories().size();
-            file.write((const char*)&u64, sizeof(u64));
-
-            // Unscaled dirs
-            boolean = false;
-            for (const auto &dir : theme.second->iconDirectories())
-            {
-                // Is Scaled
-                file.write((const char*)&boolean, sizeof(boolean));
-
-                // Cache data (size, minSize, etc)
-                file.write((const char*)dir.data(), sizeof(*dir.data()));
-
-                // Theme dir
-                file.write((const char*)dir.themeDir().data(), dir.themeDir().size() + 1);
-
-                // Dir name
-                file.write((const char*)dir.dirName().data(), dir.dirName().size() + 1);
-
-                // Icons num
-                u64 = dir.icons().size();
-                file.write((const char*)&u64, sizeof(u64));
+        std::cout << "    Found theme: " << theme.first << " => " << theme.second->indexFilePath().string() << "\n";
+        cacheFilePath = currentCacheDir / theme.first;
 
-                for (const auto &icon : dir.icons())
-                {
-                    // Icon name
-                    file.write((const char*)icon.first.data(), icon.first.size() + 1);
-
-                    // Extensions
-                    u32 = icon.second.extensions();
-                    file.write((const char*)&u32, sizeof(u32));
-                }
-            }
-
-            // Scaled dirs
-            boolean = true;
-            for (const auto &dir : theme.second->iconDirectories())
-            {
-                // Is Scaled
-                file.write((const char*)&boolean, sizeof(boolean));
-
-                // Cache data (size, minSize, etc)
-                file.write((const char*)dir.data(), sizeof(*dir.data()));
-
-                // Theme dir
-                file.write((const char*)dir.themeDir().data(), dir.themeDir().size() + 1);
-
-                // Dir name
-                file.write((const char*)dir.dirName().data(), dir.dirName().size() + 1);
-
-                // Icons num
-                u64 = dir.icons().size();
-                file.write((const char*)&u64, sizeof(u64));
-
-                for (const auto &icon : dir.icons())
-                {
-                    // Icon name
-                    file.write((const char*)icon.first.data(), icon.first.size() + 1);
-
-                    // Extensions
-                    u32 = icon.second.extensions();
-                    file.write((const char*)&u32, sizeof(u32));
-                }
-            }
-
-            file.close();
-
-            if (chmod(cacheFilePath.c_str(), S_IRUSR | S_IRGRP | S_IROTH) == 0)
-            {
-                std::cout << "        Cache permissions set to read-only: " << cacheFilePath.c_str() << "\n";
-                std::cout << "        Cache stored succesfully.\n";
-            }
-            else
-                std::cerr << "        Failed to change cache permissions: " << cacheFilePath.c_str() << "\n";
-        }
-        catch (...)
+        if (!theme.second->writeCache(cacheFilePath))
         {
             std::cout << "        Failed to write into cache file: " << theme.first << "\n";
+            continue;
+        }
+
+        if (chmod(cacheFilePath.c_str(), S_IRUSR | S_IRGRP | S_IROTH) == 0)
+        {
+            std::cout << "        Cache permissions set to read-only: " << cacheFilePath.c_str() << "\n";
+            std::cout << "        Cache stored succesfully.\n";
         }
+        else
+            std::cerr << "        Failed to change cache permissions: " << cacheFilePath.c_str() << "\n";
     }
 }
 
@@ -0,0 +1,241 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <algorithm>
+#include <fstream>
+#include <unistd.h>
+
+using namespace CZ;
+
+// Writes a cache file containing only the magic and version fields
+static bool writeCacheHeader(const std::filesystem::path &path, uint32_t magic, uint32_t version) noexcept
+{
+    std::ofstream file { path, std::ios::binary };
+    file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    return file.good();
+}
+
+XDG_TEST(cacheVersionRejected)
+{
+    const std::filesystem::path cacheDir { "/var/cache/xdgkit/icon_themes/system" };
+    std::error_code ec;
+
+    // Only the directories that didn't exist are removed afterwards
+    std::filesystem::path created { cacheDir };
+    while (!created.parent_path().empty() && !std::filesystem::exists(created.parent_path(), ec))
+        created = created.parent_path();
+
+    const bool existed { std::filesystem::exists(cacheDir, ec) };
+    std::filesystem::create_directories(cacheDir, ec);
+
+    if (access(cacheDir.c_str(), W_OK) != 0)
+        XDG_SKIP("the system cache directory is not writable");
+
+    // Unique names so installed caches are never touched
+    const std::string pid { std::to_string(getpid()) };
+    const std::string oldVersionTheme { "XDGTestOldCacheTheme-" + pid };
+    const std::string badMagicTheme { "XDGTestBadCacheTheme-" + pid };
+
+    XDGTest::Fixture fixture;
+
+    for (const auto &theme : { oldVersionTheme, badMagicTheme })
+    {
+        fixture.theme(theme,
+            "[Icon Theme]\n"
+            "Name=Cache\n"
+            "Comment=Test cache\n"
+            "Directories=32x32/apps\n\n"
+            "[32x32/apps]\nSize=32\nType=Fixed\n");
+        fixture.icons(theme, "32x32/apps", { "xdgtest-cached.png" });
+    }
+
+    XDG_CHECK(writeCacheHeader(cacheDir / oldVersionTheme, XDGIconTheme::CacheMagic, XDGIconTheme::CacheVersion - 1));
+    XDG_CHECK(writeCacheHeader(cacheDir / badMagicTheme, ~XDGIconTheme::CacheMagic, XDGIconTheme::CacheVersion));
+
+    {
+        XDGKit::Options options;
+        options.autoReloadCache = false;
+        auto kit { XDGKit::Make(options) };
+        auto &manager { kit->iconThemeManager() };
+
+        // Rejected caches fall back to loading the theme directories
+        for (const auto &theme : { oldVersionTheme, badMagicTheme })
+        {
+            const std::string_view themes[] { theme };
+            const XDGIcon *icon { manager.findIcon("xdgtest-cached", 32, 1, XDGIcon::PNG, themes) };
+            XDG_CHECK(icon && icon->directory().theme().name() == theme);
+            XDG_CHECK(icon && !icon->usingCache());
+        }
+    }
+
+    std::filesystem::remove(cacheDir / oldVersionTheme, ec);
+    std::filesystem::remove(cacheDir / badMagicTheme, ec);
+
+    if (!existed)
+        std::filesystem::remove_all(created, ec);
+}
+
+XDG_TEST(cacheAvailabilityRebuilt)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestAvailabilityCacheTheme",
+        "[Icon Theme]\n"
+        "Name=Availability\n"
+        "Comment=Test availability\n"
+        "Directories=16x16/apps,32x32/apps,scalable/apps\n\n"
+        "[16x16/apps]\nSize=16\nType=Fixed\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n\n"
+        "[scalable/apps]\nSize=64\nMinSize=16\nMaxSize=256\nType=Scalable\n");
+    fixture.icons("XDGTestAvailabilityCacheTheme", "16x16/apps", { "xdgtest-small.png", "xdgtest-both.png" });
+    fixture.icons("XDGTestAvailabilityCacheTheme", "32x32/apps", { "xdgtest-both.png", "xdgtest-both.xpm" });
+    fixture.icons("XDGTestAvailabilityCacheTheme", "scalable/apps", { "xdgtest-vector.svg" });
+
+    const std::string_view themes[] { "XDGTestAvailabilityCacheTheme" };
+    const char *names[] { "xdgtest-small", "xdgtest-both", "xdgtest-vector", "xdgtest-missing-icon" };
+    std::vector<std::pair<std::string, XDGIconTheme::Availability>> expected;
+    size_t tableSize { 2 * sizeof(uint64_t) };
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+        auto &manager { kit->iconThemeManager() };
+        manager.findIcon("xdgtest-small", 16, 1, XDGIcon::PNG, themes);
+
+        for (const auto &icon : manager.themes().find(themes[0])->second->iconAvailability())
+        {
+            expected.emplace_back(icon.first, icon.second);
+            tableSize += icon.first.size() + 1 + sizeof(icon.second);
+        }
+    }
+
+    XDG_CHECK(expected.size() == 3);
+
+    if (!fixture.cache({ themes[0] }))
+        XDG_SKIP("the system cache directory is not writable");
+
+    // The availability table ends the file and starts with the number of size classes
+    const std::filesystem::path cacheFile { "/var/cache/xdgkit/icon_themes/system/XDGTestAvailabilityCacheTheme" };
+    const uint64_t wrongCount { 7 };
+    {
+        std::fstream file { cacheFile, std::ios::binary | std::ios::in | std::ios::out };
+        file.seekp(std::filesystem::file_size(cacheFile) - tableSize);
+        file.write(reinterpret_cast<const char*>(&wrongCount), sizeof(wrongCount));
+        XDG_CHECK(file.good());
+    }
+
+    XDGKit::Options options;
+    options.autoReloadCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    // The directories still come from the cache, the stale masks are rebuilt from them
+    const XDGIcon *icon { manager.findIcon("xdgtest-small", 16, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(icon && icon->usingCache());
+
+    const auto &availability { manager.themes().find(themes[0])->second->iconAvailability() };
+    XDG_CHECK(availability.size() == expected.size());
+
+    for (const auto &[name, masks] : expected)
+    {
+        const auto it { availability.find(name) };
+        XDG_CHECK(it != availability.end() && it->second.png == masks.png && it->second.svg == masks.svg && it->second.xpm == masks.xpm);
+    }
+
+    for (const char *name : names)
+        for (int32_t size : { 16, 24, 32, 128 })
+            XDG_CHECK((manager.findIcon(name, size, 1, XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM, themes) != nullptr) == (std::string_view(name) != "xdgtest-missing-icon"));
+}
+
+XDG_TEST(cacheMapFlags)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestMapTheme",
+        "[Icon Theme]\n"
+        "Name=Map\n"
+        "Comment=Test map\n"
+        "Directories=16x16/apps,32x32/apps,32x32/devices,scalable/apps\n"
+        "ScaledDirectories=32x32@2/apps\n\n"
+        "[16x16/apps]\nSize=16\nType=Fixed\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n\n"
+        "[32x32/devices]\nSize=32\nContext=Devices\nType=Fixed\n\n"
+        "[32x32@2/apps]\nSize=32\nScale=2\nType=Fixed\n\n"
+        "[scalable/apps]\nSize=64\nMinSize=16\nMaxSize=256\nType=Scalable\n");
+    fixture.icons("XDGTestMapTheme", "16x16/apps", { "xdgtest-map-a.png", "xdgtest-map-b.png" });
+    fixture.icons("XDGTestMapTheme", "32x32/apps", { "xdgtest-map-a.png", "xdgtest-map-a.xpm" });
+    fixture.icons("XDGTestMapTheme", "32x32/devices", { "xdgtest-map-device.png" });
+    fixture.icons("XDGTestMapTheme", "32x32@2/apps", { "xdgtest-map-a.png", "xdgtest-map-b.png" });
+    fixture.icons("XDGTestMapTheme", "scalable/apps", { "xdgtest-map-b.svg", "xdgtest-map-c.svg" });
+
+    const std::string_view themes[] { "XDGTestMapTheme" };
+    const char *names[] { "xdgtest-map-a", "xdgtest-map-b", "xdgtest-map-c", "xdgtest-map-device", "xdgtest-missing-icon" };
+
+    // Directory name and icon name of every result
+    const auto lookup = [&](XDGIconThemeManager &manager)
+    {
+        std::vector<std::string> results;
+
+        for (const char *name : names)
+        {
+            for (int32_t size : { 16, 24, 32, 64 })
+            {
+                for (int32_t scale : { 1, 2 })
+                {
+                    const XDGIcon *icon { manager.findIcon(name, size, scale, XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM, themes) };
+                    results.emplace_back(icon ? std::string(icon->directory().dirName()) + "/" + std::string(icon->name()) : "");
+                }
+            }
+        }
+
+        return results;
+    };
+
+    std::vector<std::string> expected;
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+        expected = lookup(kit->iconThemeManager());
+    }
+
+    XDG_CHECK(std::count(expected.begin(), expected.end(), "") < (std::ptrdiff_t)expected.size());
+
+    // Written like the indexer does
+    if (!fixture.cache({ themes[0] }))
+        XDG_SKIP("the system cache directory is not writable");
+
+    const uint32_t flagSets[] { 0, XDGKit::CacheMapPopulate, XDGKit::CacheMapWillNeed, XDGKit::CacheMapRandom,
+                                XDGKit::CacheMapPopulate | XDGKit::CacheMapWillNeed | XDGKit::CacheMapRandom };
+    const uintptr_t pageMask { (uintptr_t)sysconf(_SC_PAGESIZE) - 1 };
+
+    for (uint32_t flags : flagSets)
+    {
+        XDGKit::Options options;
+        options.autoReloadCache = false;
+        options.cacheMapFlags = flags;
+        auto kit { XDGKit::Make(options) };
+        auto &manager { kit->iconThemeManager() };
+        XDG_CHECK(lookup(manager) == expected);
+
+        // The directory table is contiguous and starts at a page boundary of the mapping
+        const auto &theme { *manager.themes().find(themes[0])->second };
+        XDG_CHECK(theme.usingCache());
+        uintptr_t first { UINTPTR_MAX }, last { 0 };
+        size_t numDirs { 0 };
+
+        for (const auto *dirs : { &theme.scaledIconDirectories(), &theme.iconDirectories() })
+        {
+            for (const auto &dir : *dirs)
+            {
+                first = std::min(first, (uintptr_t)dir.data());
+                last = std::max(last, (uintptr_t)dir.data());
+                numDirs++;
+            }
+        }
+
+        XDG_CHECK(numDirs == 5);
+        XDG_CHECK((first & pageMask) == 0);
+        XDG_CHECK(last - first == (numDirs - 1) * sizeof(XDGIconDirectory::Cache));
+    }
+}
@@ -0,0 +1,322 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+using namespace CZ;
+
+static void writeIconTheme(XDGTest::Fixture &fixture) noexcept
+{
+    fixture.theme("XDGTestIconTheme",
+        "[Icon Theme]\n"
+        "Name=Icon\n"
+        "Comment=Test icon\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+    fixture.icons("XDGTestIconTheme", "32x32/apps", { "xdgtest-all-formats.png", "xdgtest-all-formats.svg", "xdgtest-all-formats.xpm" });
+}
+
+static void checkWritePath(XDGIconThemeManager &manager, bool usingCache) noexcept
+{
+    const std::string_view themes[] { "XDGTestIconTheme" };
+    const XDGIcon *icon { manager.findIcon("xdgtest-all-formats", 32, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(icon && icon->usingCache() == usingCache);
+
+    if (!icon)
+        return;
+
+    const XDGIcon::Extension extensions[] { XDGIcon::PNG, XDGIcon::SVG, XDGIcon::XPM };
+    const size_t length { icon->pathLength() };
+    char buffer[PATH_MAX];
+
+    for (auto ext : extensions)
+    {
+        const std::string path { icon->getPath(ext).string() };
+        XDG_CHECK(length == path.size());
+
+        const size_t before { XDGTest::allocations() };
+        const size_t written { icon->writePath(ext, buffer) };
+        const size_t exact { icon->writePath(ext, std::span<char>(buffer, length + 1)) };
+        const size_t truncated { icon->writePath(ext, std::span<char>(buffer, length)) };
+        XDG_CHECK(XDGTest::allocations() == before);
+
+        XDG_CHECK(written == length && exact == length);
+
+        // No room for the null terminator
+        XDG_CHECK(truncated == 0);
+
+        icon->writePath(ext, buffer);
+        XDG_CHECK(std::string_view(buffer) == path);
+    }
+
+    // Not a single file format
+    XDG_CHECK(icon->writePath(XDGIcon::Extension(0), buffer) == 0);
+    XDG_CHECK(icon->writePath(XDGIcon::Extension(XDGIcon::PNG | XDGIcon::SVG), buffer) == 0);
+    XDG_CHECK(icon->writePath(XDGIcon::Symbolic, buffer) == 0);
+}
+
+XDG_TEST(iconWritePath)
+{
+    XDGTest::Fixture fixture;
+    writeIconTheme(fixture);
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+        checkWritePath(kit->iconThemeManager(), false);
+    }
+
+    if (!fixture.cache({ "XDGTestIconTheme" }))
+        XDG_SKIP("the system cache directory is not writable");
+
+    XDGKit::Options options;
+    options.autoReloadCache = false;
+    auto kit { XDGKit::Make(options) };
+    checkWritePath(kit->iconThemeManager(), true);
+}
+
+static size_t openFds() noexcept
+{
+    std::error_code ec;
+    size_t count { 0 };
+
+    for (auto it = std::filesystem::directory_iterator("/proc/self/fd", ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+        count++;
+
+    return count;
+}
+
+XDG_TEST(iconOpenReplacedDirectory)
+{
+    XDGTest::Fixture fixture;
+    writeIconTheme(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    const std::string_view themes[] { "XDGTestIconTheme" };
+    const XDGIcon *icon { kit->iconThemeManager().findIcon("xdgtest-all-formats", 32, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(icon != nullptr);
+
+    if (!icon)
+        return;
+
+    // Caches the directory fd
+    int fd { icon->open(XDGIcon::PNG, O_RDONLY) };
+    XDG_CHECK(fd != -1);
+    close(fd);
+
+    // The cached fd now refers to a directory without the file
+    const std::filesystem::path dir { icon->directory().path() };
+    const std::filesystem::path old { fixture.iconsDir() / "replaced" };
+    std::filesystem::rename(dir, old);
+    std::filesystem::remove(old / "xdgtest-all-formats.png");
+    std::filesystem::remove(old / "xdgtest-all-formats.xpm");
+    std::filesystem::create_directories(dir);
+    std::ofstream { dir / "xdgtest-all-formats.png" } << "new";
+
+    // Retried with the full path
+    fd = icon->open(XDGIcon::PNG, O_RDONLY);
+    XDG_CHECK(fd != -1);
+
+    if (fd == -1)
+        return;
+
+    char contents[4] {};
+    XDG_CHECK(read(fd, contents, sizeof(contents)) == 3 && std::string_view(contents) == "new");
+    close(fd);
+
+    // Missing in both directories
+    XDG_CHECK(icon->open(XDGIcon::XPM, O_RDONLY) == -1 && errno == ENOENT);
+    XDG_CHECK(icon->open(XDGIcon::Extension(0), O_RDONLY) == -1 && errno == EINVAL);
+}
+
+XDG_TEST(iconOpenFdLimit)
+{
+    XDGTest::Fixture fixture;
+    constexpr size_t dirCount { XDGIconTheme::MaxDirectoryFds + 16 };
+    std::string dirs, sections;
+
+    for (size_t i = 0; i < dirCount; i++)
+    {
+        const std::string dir { "dir" + std::to_string(i) };
+        dirs += (i ? "," : "") + dir;
+        sections += "\n[" + dir + "]\nSize=" + std::to_string(16 + i) + "\nType=Fixed\n";
+        fixture.icons("XDGTestIconTheme", dir, { "xdgtest-fd.png" });
+    }
+
+    fixture.theme("XDGTestIconTheme", "[Icon Theme]\nName=Icon\nComment=Test icon\nDirectories=" + dirs + "\n" + sections);
+
+    const size_t before { openFds() };
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+        const std::string_view themes[] { "XDGTestIconTheme" };
+        XDG_CHECK(kit->iconThemeManager().findIcon("xdgtest-fd", 16, 1, XDGIcon::PNG, themes));
+
+        auto &theme { *kit->iconThemeManager().themes().find("XDGTestIconTheme")->second };
+        const size_t kitFds { openFds() };
+        size_t opened { 0 };
+
+        // Every directory twice, the oldest fds are evicted
+        for (int round = 0; round < 2; round++)
+        {
+            for (const auto &dir : theme.iconDirectories())
+            {
+                const int fd { dir.icons().find("xdgtest-fd")->open(XDGIcon::PNG, O_RDONLY) };
+                opened += fd != -1;
+                close(fd);
+                XDG_CHECK(openFds() <= kitFds + XDGIconTheme::MaxDirectoryFds);
+            }
+        }
+
+        XDG_CHECK(opened == 2 * dirCount);
+        XDG_CHECK(openFds() == kitFds + XDGIconTheme::MaxDirectoryFds);
+
+        theme.closeDirectoryFds();
+        XDG_CHECK(openFds() == kitFds);
+    }
+
+    XDG_CHECK(openFds() == before);
+}
+
+// Same hash as XDGIconDirectory::findIcon(): fmix64 of std::hash, the top 8 bits are the tag
+static uint64_t iconNameHash(std::string_view name) noexcept
+{
+    uint64_t h { static_cast<uint64_t>(std::hash<std::string_view>{}(name)) };
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// The address belongs to a mapping of the file
+static bool mappedFrom(const void *address, const std::filesystem::path &file) noexcept
+{
+    std::ifstream maps { "/proc/self/maps" };
+    std::string line;
+    const uintptr_t addr { reinterpret_cast<uintptr_t>(address) };
+
+    while (std::getline(maps, line))
+    {
+        uintptr_t begin, end;
+
+        if (sscanf(line.c_str(), "%lx-%lx", &begin, &end) != 2 || addr < begin || addr >= end)
+            continue;
+
+        return line.ends_with(file.string());
+    }
+
+    return false;
+}
+
+XDG_TEST(iconIndex)
+{
+    // Sized so that the table has 128 slots, see XDGIconDirectory::initIconIndex()
+    constexpr size_t iconCount { 48 };
+    constexpr size_t mask { std::bit_ceil(iconCount + iconCount / 3 + 1) - 1 };
+    static_assert(mask == 127);
+
+    // Names starting at the last slot wrap to the first one, names sharing a slot and a tag are told apart by comparing them
+    std::vector<std::string> wrapNames, tagNames, fillerNames;
+    std::string tagMiss;
+    uint64_t tagHash { 0 };
+
+    for (size_t i = 0; wrapNames.size() < 3 || tagNames.size() < 3 || tagMiss.empty(); i++)
+    {
+        std::string name { "xdgtest-index-" + std::to_string(i) };
+        const uint64_t hash { iconNameHash(name) };
+
+        if ((hash & mask) == mask)
+        {
+            if (wrapNames.size() < 3)
+                wrapNames.emplace_back(std::move(name));
+        }
+        else if (tagNames.empty())
+        {
+            tagHash = hash;
+            tagNames.emplace_back(std::move(name));
+        }
+        else if ((hash & mask) == (tagHash & mask) && hash >> 56 == tagHash >> 56)
+        {
+            if (tagNames.size() < 3)
+                tagNames.emplace_back(std::move(name));
+            else if (tagMiss.empty())
+                tagMiss = std::move(name);
+        }
+        else if (fillerNames.size() < iconCount - 7 && (hash & mask) != (tagHash & mask))
+            fillerNames.emplace_back(std::move(name));
+    }
+
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestIconTheme",
+        "[Icon Theme]\n"
+        "Name=Icon\n"
+        "Comment=Test icon\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+
+    // Two files, one record
+    fixture.icons("XDGTestIconTheme", "32x32/apps", { "xdgtest-merged.png", "xdgtest-merged.svg" });
+
+    for (const auto *names : { &wrapNames, &tagNames, &fillerNames })
+        for (const auto &name : *names)
+            fixture.icons("XDGTestIconTheme", "32x32/apps", { name + ".png" });
+
+    const auto check = [&](XDGIconThemeManager &manager, bool usingCache)
+    {
+        const std::string_view themes[] { "XDGTestIconTheme" };
+        const XDGIcon *merged { manager.findIcon("xdgtest-merged", 32, 1, XDGIcon::PNG, themes) };
+        XDG_CHECK(merged && merged->usingCache() == usingCache);
+
+        if (!merged)
+            return;
+
+        const auto icons { merged->directory().icons() };
+        XDG_CHECK(icons.size() == iconCount);
+        XDG_CHECK(merged->extensions() == (XDGIcon::PNG | XDGIcon::SVG));
+        XDG_CHECK(std::count_if(icons.begin(), icons.end(), [](const XDGIcon &icon) { return icon.name() == "xdgtest-merged"; }) == 1);
+
+        for (const auto *names : { &wrapNames, &tagNames, &fillerNames })
+        {
+            for (const auto &name : *names)
+            {
+                const XDGIcon *icon { icons.find(name) };
+                XDG_CHECK(icon && icon->name() == name && icon->extensions() == XDGIcon::PNG);
+            }
+        }
+
+        XDG_CHECK(!icons.find(tagMiss));
+        XDG_CHECK(!icons.find("xdgtest-merged.png"));
+        XDG_CHECK(!icons.find(""));
+
+        // Names are null-terminated in place, within the cache file when mapped
+        XDG_CHECK(merged->name().data()[merged->name().size()] == '\0');
+
+        if (usingCache)
+            XDG_CHECK(mappedFrom(merged->name().data(), "/var/cache/xdgkit/icon_themes/system/XDGTestIconTheme"));
+    };
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+        check(kit->iconThemeManager(), false);
+    }
+
+    if (!fixture.cache({ "XDGTestIconTheme" }))
+        XDG_SKIP("the system cache directory is not writable");
+
+    XDGKit::Options options;
+    options.autoReloadCache = false;
+    auto kit { XDGKit::Make(options) };
+    check(kit->iconThemeManager(), true);
+}
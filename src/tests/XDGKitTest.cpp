@@ -0,0 +1,118 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace CZ;
+
+XDG_TEST(kitBackgroundInit)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestKitTheme",
+        "[Icon Theme]\n"
+        "Name=Kit\n"
+        "Comment=Test kit\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+    fixture.icons("XDGTestKitTheme", "32x32/apps", { "xdgtest-kit.png" });
+
+    auto reference { XDGKit::Make() };
+
+    XDGKit::Options options;
+    options.backgroundInit = true;
+    auto kit { XDGKit::Make(options) };
+
+    // Accessors may wait for the init thread concurrently
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches { 0 };
+
+    for (int i = 0; i < 4; i++)
+        threads.emplace_back([&]{
+            if (kit->homeDir() != reference->homeDir() || kit->dataDirs() != reference->dataDirs() || kit->username() != reference->username())
+                mismatches++; });
+
+    for (auto &thread : threads)
+        thread.join();
+
+    XDG_CHECK(mismatches == 0);
+    XDG_CHECK(kit->initialized());
+    XDG_CHECK(kit->iconThemeManager().searchDirs() == reference->iconThemeManager().searchDirs());
+    XDG_CHECK(kit->iconThemeManager().findIcon("xdgtest-kit", 32));
+
+    // Destroyed while initializing
+    kit = XDGKit::Make(options);
+    kit.reset();
+}
+
+XDG_TEST(kitBackgroundInitEnv)
+{
+    XDGTest::Fixture fixture;
+    const std::string dataDirs { getenv("XDG_DATA_DIRS") };
+
+    XDGKit::Options options;
+    options.backgroundInit = true;
+    auto kit { XDGKit::Make(options) };
+
+    // The environment is read by the constructor, not the init thread
+    setenv("XDG_DATA_DIRS", "/", 1);
+    XDG_CHECK(kit->dataDirs().size() == 1 && kit->dataDirs()[0] == dataDirs);
+}
+
+XDG_TEST(kitBackgroundInitThemes)
+{
+    XDGTest::Fixture fixture;
+
+    for (int i = 0; i < 100; i++)
+    {
+        const std::string name { "XDGTestKitTheme" + std::to_string(i) };
+        fixture.theme(name,
+            "[Icon Theme]\n"
+            "Name=Kit\n"
+            "Comment=Test kit\n"
+            "Inherits=XDGTestKitTheme" + std::to_string((i + 1) % 100) + "\n"
+            "Directories=32x32/apps\n\n"
+            "[32x32/apps]\nSize=32\nType=Fixed\n");
+        fixture.icons(name, "32x32/apps", { "xdgtest-kit-" + std::to_string(i) + ".png" });
+    }
+
+    fixture.theme("hicolor",
+        "[Icon Theme]\n"
+        "Name=Hicolor\n"
+        "Comment=Test hicolor\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+
+    for (bool allowlist : { false, true })
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+
+        if (allowlist)
+            options.themes = { "XDGTestKitTheme0" };
+
+        auto reference { XDGKit::Make(options) };
+        options.backgroundInit = true;
+        auto kit { XDGKit::Make(options) };
+        auto &manager { kit->iconThemeManager() };
+
+        // Searching a theme (and its inherited themes) doesn't wait for the others
+        const std::string_view themes[] { "XDGTestKitTheme50" };
+        XDG_CHECK(manager.findIcon("xdgtest-kit-20", 32, 1, XDGIcon::PNG, themes));
+
+        const auto *theme { manager.themes().find("XDGTestKitTheme50")->second.get() };
+        const std::vector<std::string> inherits { "XDGTestKitTheme51", "hicolor" };
+        XDG_CHECK(theme->inherits() == inherits);
+
+        // All themes once "" is used
+        XDG_CHECK(manager.findIcon("xdgtest-kit-99", 32, 1, XDGIcon::PNG));
+        XDG_CHECK(manager.themes().size() == reference->iconThemeManager().themes().size());
+
+        for (const auto &entry : reference->iconThemeManager().themes())
+        {
+            const auto &it { manager.themes().find(entry.first) };
+            XDG_CHECK(it != manager.themes().end() && it->second->inherits() == entry.second->inherits());
+        }
+    }
+}
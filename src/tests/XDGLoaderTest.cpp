@@ -0,0 +1,219 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <poll.h>
+#include <set>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace CZ;
+
+static void writeTheme(XDGTest::Fixture &fixture) noexcept
+{
+    fixture.theme("XDGTestLoaderTheme",
+        "[Icon Theme]\n"
+        "Name=Loader\n"
+        "Comment=Test loader\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+    fixture.icons("XDGTestLoaderTheme", "32x32/apps", { "xdgtest-loaded.png" });
+}
+
+// Waits for the background loader to signal a loaded theme
+static bool waitLoaded(XDGIconThemeManager &manager) noexcept
+{
+    pollfd fd { .fd = manager.loaderFd(), .events = POLLIN, .revents = 0 };
+    return fd.fd != -1 && poll(&fd, 1, 5000) == 1;
+}
+
+XDG_TEST(loaderReloadsTrimmedThemes)
+{
+    XDGTest::Fixture fixture;
+    writeTheme(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestLoaderTheme" };
+    XDGIconThemeManager::LookupStatus status;
+    bool called { false };
+
+    XDG_CHECK(!manager.findIconNonBlocking(status, XDGIconThemeManager::NeverBlock, [&called]{ called = true; },
+        "xdgtest-loaded", 32, 1, XDGIcon::PNG, themes));
+    XDG_CHECK(status == XDGIconThemeManager::Partial);
+
+    // Trimmed after loading but before the callback is dispatched
+    XDG_CHECK(waitLoaded(manager));
+    manager.trimMemory(0);
+    XDG_CHECK(!manager.themes().find("XDGTestLoaderTheme")->second->initialized());
+    manager.dispatchLoaded();
+    XDG_CHECK(!called);
+
+    // Loaded again
+    while (!called && waitLoaded(manager))
+        manager.dispatchLoaded();
+
+    XDG_CHECK(called);
+    const XDGIcon *icon { manager.findIconNonBlocking(status, XDGIconThemeManager::NeverBlock, nullptr,
+        "xdgtest-loaded", 32, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(icon && status == XDGIconThemeManager::Complete);
+}
+
+XDG_TEST(loaderUnavailable)
+{
+    XDGTest::Fixture fixture;
+    writeTheme(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestLoaderTheme" };
+    XDGIconThemeManager::LookupStatus status;
+    bool called { false };
+
+    // Makes creating the loader fd fail
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    const int lowestFd { dup(0) };
+    close(lowestFd);
+    rlimit lowered { limit };
+    lowered.rlim_cur = lowestFd;
+    setrlimit(RLIMIT_NOFILE, &lowered);
+
+    const XDGIcon *icon { manager.findIconNonBlocking(status, XDGIconThemeManager::NeverBlock, [&called]{ called = true; },
+        "xdgtest-loaded", 32, 1, XDGIcon::PNG, themes) };
+    const XDGIconFuture future { manager.findIconAsync("xdgtest-loaded", 32, 1, XDGIcon::PNG, themes) };
+
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    // Completed without the skipped theme instead of waiting forever
+    XDG_CHECK(!icon && status == XDGIconThemeManager::Complete);
+    XDG_CHECK(future.ready() && !future.get());
+    manager.dispatchLoaded();
+    XDG_CHECK(!called);
+    XDG_CHECK(manager.findIcon("xdgtest-loaded", 32, 1, XDGIcon::PNG, themes));
+}
+
+XDG_TEST(loaderResolvesTrimmedFutures)
+{
+    XDGTest::Fixture fixture;
+    writeTheme(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestLoaderTheme" };
+
+    XDGIconFuture future { manager.findIconAsync("xdgtest-loaded", 32, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(future.valid() && !future.ready());
+
+    // Trimmed after loading but before the future is resolved
+    XDG_CHECK(waitLoaded(manager));
+    manager.trimMemory(0);
+    manager.dispatchLoaded();
+    XDG_CHECK(!future.ready());
+
+    while (!future.ready() && waitLoaded(manager))
+        manager.dispatchLoaded();
+
+    XDG_CHECK(future.ready() && future.get());
+}
+
+XDG_TEST(loaderCompactThemes)
+{
+    XDGTest::Fixture fixture;
+    writeTheme(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    options.compactThemes = true;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestLoaderTheme" };
+    XDGIconThemeManager::LookupStatus status;
+
+    manager.findIconNonBlocking(status, XDGIconThemeManager::NeverBlock, nullptr, "xdgtest-loaded", 32, 1, XDGIcon::PNG, themes);
+    const XDGIconTheme &theme { *manager.themes().find("XDGTestLoaderTheme")->second };
+
+    // The index data is released before the theme is published as initialized
+    while (!theme.initialized() && waitLoaded(manager))
+        manager.dispatchLoaded();
+
+    XDG_CHECK(theme.initialized() && theme.indexData().empty());
+    XDG_CHECK(manager.findIcon("xdgtest-loaded", 32, 1, XDGIcon::PNG, themes));
+}
+
+XDG_TEST(loaderPrefetchOpensFiles)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestLoaderTheme",
+        "[Icon Theme]\n"
+        "Name=Loader\n"
+        "Comment=Test loader\n"
+        "Directories=16x16/apps,32x32/apps\n\n"
+        "[16x16/apps]\nSize=16\nType=Fixed\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+    fixture.icons("XDGTestLoaderTheme", "16x16/apps", { "xdgtest-a.png", "xdgtest-b.png", "xdgtest-b.xpm" });
+    fixture.icons("XDGTestLoaderTheme", "32x32/apps", { "xdgtest-a.png", "xdgtest-a.svg", "xdgtest-c.svg" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestLoaderTheme" };
+    const XDGIcon *icons[] {
+        manager.findIcon("xdgtest-a", 16, 1, XDGIcon::PNG | XDGIcon::SVG, themes),
+        manager.findIcon("xdgtest-b", 16, 1, XDGIcon::PNG | XDGIcon::SVG, themes),
+        manager.findIcon("xdgtest-a", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes),
+        manager.findIcon("xdgtest-c", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes),
+        manager.findIcon("xdgtest-a", 16, 1, XDGIcon::PNG | XDGIcon::SVG, themes),
+        nullptr };
+
+    for (const XDGIcon *icon : std::span(icons, 5))
+        XDG_CHECK(icon != nullptr);
+
+    // Files opened in the directories, reported by inotify
+    const int inotifyFd { inotify_init1(IN_CLOEXEC | IN_NONBLOCK) };
+    XDG_CHECK(inotifyFd != -1);
+
+    if (inotifyFd == -1)
+        return;
+
+    const std::string dirs[] { (fixture.iconsDir() / "XDGTestLoaderTheme/16x16/apps").string(), (fixture.iconsDir() / "XDGTestLoaderTheme/32x32/apps").string() };
+    const int watches[] { inotify_add_watch(inotifyFd, dirs[0].c_str(), IN_OPEN), inotify_add_watch(inotifyFd, dirs[1].c_str(), IN_OPEN) };
+
+    // Only the PNG files, each one once even if listed twice
+    manager.prefetch(icons, XDGIcon::PNG);
+
+    const std::set<std::string> expected { "16/xdgtest-a.png", "16/xdgtest-b.png", "32/xdgtest-a.png" };
+    std::vector<std::string> opened;
+    alignas(inotify_event) char buffer[4096];
+    pollfd fd { .fd = inotifyFd, .events = POLLIN, .revents = 0 };
+
+    while (opened.size() < expected.size() && poll(&fd, 1, 5000) == 1)
+    {
+        const ssize_t size { read(inotifyFd, buffer, sizeof(buffer)) };
+
+        for (ssize_t pos = 0; pos < size; pos += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(buffer + pos)->len)
+        {
+            const auto *event { reinterpret_cast<inotify_event*>(buffer + pos) };
+
+            // The directories themselves
+            if (event->len == 0)
+                continue;
+
+            opened.emplace_back((event->wd == watches[0] ? "16/" : "32/") + std::string(event->name));
+        }
+    }
+
+    // Nothing else shows up once the expected files were opened
+    if (poll(&fd, 1, 100) == 1)
+        opened.emplace_back("unexpected");
+
+    close(inotifyFd);
+    XDG_CHECK(opened.size() == expected.size());
+    XDG_CHECK(std::set<std::string>(opened.begin(), opened.end()) == expected);
+}
@@ -0,0 +1,615 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGIconQuery.h>
+#include <CZ/XDG/XDGKit.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace CZ;
+
+static void writeThemes(XDGTest::Fixture &fixture) noexcept
+{
+    fixture.theme("XDGTestParentTheme",
+        "[Icon Theme]\n"
+        "Name=Parent\n"
+        "Comment=Test parent\n"
+        "Directories=32x32/apps,scalable/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n\n"
+        "[scalable/apps]\nSize=64\nMinSize=16\nMaxSize=256\nType=Scalable\n");
+    fixture.icons("XDGTestParentTheme", "32x32/apps", { "xdgtest-application.png", "xdgtest-parent-only.png" });
+    fixture.icons("XDGTestParentTheme", "scalable/apps", { "xdgtest-vector-only.svg" });
+
+    fixture.theme("XDGTestChildTheme",
+        "[Icon Theme]\n"
+        "Name=Child\n"
+        "Comment=Test child\n"
+        "Inherits=XDGTestParentTheme\n"
+        "Directories=16x16/apps\n\n"
+        "[16x16/apps]\nSize=16\nType=Fixed\n");
+    fixture.icons("XDGTestChildTheme", "16x16/apps", { "xdgtest-application.png" });
+}
+
+XDG_TEST(lookupDoesNotAllocate)
+{
+    XDGTest::Fixture fixture;
+    writeThemes(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    // Longer than the small string buffer, so converting them to std::string would allocate
+    const char *names[] { "xdgtest-application", "xdgtest-parent-only", "xdgtest-vector-only", "xdgtest-missing-icon" };
+    const std::string_view themes[] { "XDGTestChildTheme" };
+    const std::string_view unknownThemes[] { "XDGTestUnknownTheme", "XDGTestChildTheme" };
+
+    // Misses visit (and load) every theme, and build the tables used for the closest size fallback
+    XDG_CHECK(!manager.findIcon(names[3], 16, 1, XDGIcon::PNG, themes));
+    XDG_CHECK(!manager.findIcon(names[3], 16, 1, XDGIcon::PNG));
+    XDG_CHECK(!manager.findIcon(names[3], 16, 1, XDGIcon::PNG, unknownThemes));
+
+    const size_t before { XDGTest::allocations() };
+    size_t found { 0 };
+
+    for (int round = 0; round < 10; round++)
+    {
+        for (const char *name : names)
+        {
+            for (int32_t size : { 16, 24, 32, 64, 512 })
+            {
+                // Exact matches, inherited themes, closest size fallbacks and misses
+                found += manager.findIcon(name, size, 1, XDGIcon::PNG | XDGIcon::SVG, themes) != nullptr;
+                found += manager.findIcon(name, size, 2, XDGIcon::PNG | XDGIcon::SVG) != nullptr;
+                found += manager.findIcon(name, size, 1, XDGIcon::PNG, unknownThemes) != nullptr;
+            }
+        }
+    }
+
+    XDG_CHECK(XDGTest::allocations() == before);
+    XDG_CHECK(found > 0);
+
+    // Results are the same as with owning strings
+    const XDGIcon *icon { manager.findIcon(std::string("xdgtest-application"), 32, 1, XDGIcon::PNG, std::vector<std::string>{ "XDGTestChildTheme" }) };
+    XDG_CHECK(icon && icon->directory().theme().name() == "XDGTestParentTheme");
+    XDG_CHECK(manager.findIcon(names[0], 32, 1, XDGIcon::PNG, themes) == icon);
+}
+
+XDG_TEST(lookupClosestSize)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestClosestTheme",
+        "[Icon Theme]\n"
+        "Name=Closest\n"
+        "Comment=Test closest size\n"
+        "Directories=scalable@2/apps,48x48/apps\n\n"
+        "[scalable@2/apps]\nSize=64\nScale=2\nMinSize=16\nMaxSize=256\nType=Scalable\n\n"
+        "[48x48/apps]\nSize=48\nType=Fixed\n");
+    fixture.icons("XDGTestClosestTheme", "scalable@2/apps", { "xdgtest-closest.png", "xdgtest-range-only.png" });
+    fixture.icons("XDGTestClosestTheme", "48x48/apps", { "xdgtest-closest.png" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestClosestTheme" };
+
+    // The scalable directory contains the buffer size (32) but doesn't match the scale, so the closest fixed size wins
+    const XDGIcon *icon { manager.findIcon("xdgtest-closest", 32, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(icon && icon->directory().dirName() == "48x48/apps");
+
+    // Used only if nothing else is available
+    icon = manager.findIcon("xdgtest-range-only", 32, 1, XDGIcon::PNG, themes);
+    XDG_CHECK(icon && icon->directory().dirName() == "scalable@2/apps");
+
+    // Exact match
+    icon = manager.findIcon("xdgtest-closest", 16, 2, XDGIcon::PNG, themes);
+    XDG_CHECK(icon && icon->directory().dirName() == "scalable@2/apps");
+}
+
+XDG_TEST(lookupAllowlistInherits)
+{
+    XDGTest::Fixture fixture;
+
+    // C inherits A, which inherits B, each one with enough parents to grow the themes map while loading
+    for (const char *theme : { "C", "A", "B" })
+    {
+        std::string inherits { theme == std::string_view("C") ? "A" : theme == std::string_view("A") ? "B" : "" };
+
+        for (int i = 0; i < 40; i++)
+        {
+            const std::string parent { std::string("XDGTestParent") + theme + std::to_string(i) };
+            inherits += "," + parent;
+            fixture.theme(parent,
+                "[Icon Theme]\nName=Parent\nComment=Test parent\nDirectories=32x32/apps\n\n"
+                "[32x32/apps]\nSize=32\nType=Fixed\n");
+        }
+
+        fixture.theme(theme,
+            "[Icon Theme]\n"
+            "Name=Theme\n"
+            "Comment=Test theme\n"
+            "Inherits=" + inherits + "\n"
+            "Directories=32x32/apps\n\n"
+            "[32x32/apps]\nSize=32\nType=Fixed\n");
+    }
+
+    fixture.icons("B", "32x32/apps", { "xdgtest-inherited.png" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    options.themes = { "C" };
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    const auto &it { manager.themes().find("C") };
+    XDG_CHECK(it != manager.themes().end() && it->second->inherits().size() == 41 && it->second->inherits()[0] == "A");
+    XDG_CHECK(manager.themes().size() == 3 + 3 * 40);
+
+    const std::string_view themes[] { "C" };
+    const XDGIcon *icon { manager.findIcon("xdgtest-inherited", 32, 1, XDGIcon::PNG, themes) };
+    XDG_CHECK(icon && icon->directory().theme().name() == "B");
+}
+
+XDG_TEST(lookupQueryMatchesFindIcon)
+{
+    XDGTest::Fixture fixture;
+    writeThemes(fixture);
+    fixture.theme("XDGTestContextTheme",
+        "[Icon Theme]\n"
+        "Name=Context\n"
+        "Comment=Test contexts\n"
+        "Directories=32x32/actions,32x32/devices,scalable/devices\n\n"
+        "[32x32/actions]\nSize=32\nContext=Actions\nType=Fixed\n\n"
+        "[32x32/devices]\nSize=32\nContext=Devices\nType=Fixed\n\n"
+        "[scalable/devices]\nSize=64\nMinSize=16\nMaxSize=256\nContext=Devices\nType=Scalable\n");
+    fixture.icons("XDGTestContextTheme", "32x32/actions", { "xdgtest-application.png", "xdgtest-action.png" });
+    fixture.icons("XDGTestContextTheme", "32x32/devices", { "xdgtest-device.png" });
+    fixture.icons("XDGTestContextTheme", "scalable/devices", { "xdgtest-application.svg", "xdgtest-device.svg" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    const std::vector<std::vector<std::string_view>> themeLists {
+        { "XDGTestChildTheme" },
+        { "" },
+        { "XDGTestContextTheme", "XDGTestChildTheme" },
+        { "XDGTestUnknownTheme", "XDGTestParentTheme", "" } };
+    const char *names[] { "xdgtest-application", "xdgtest-parent-only", "xdgtest-vector-only", "xdgtest-action",
+                          "xdgtest-device", "xdgtest-missing-icon" };
+    const uint32_t extensionSets[] { XDGIcon::PNG, XDGIcon::SVG, XDGIcon::PNG | XDGIcon::SVG };
+    const uint32_t contextSets[] { XDGIconDirectory::AnyContext, XDGIconDirectory::NoContext, XDGIconDirectory::Actions | XDGIconDirectory::Devices };
+    size_t found { 0 };
+
+    for (const auto &themes : themeLists)
+    {
+        for (uint32_t extensions : extensionSets)
+        {
+            for (uint32_t contexts : contextSets)
+            {
+                XDGIconQuery query { manager, themes, extensions, contexts };
+
+                for (const char *name : names)
+                {
+                    for (int32_t size : { 16, 32, 48, 128 })
+                    {
+                        for (int32_t scale : { 1, 2 })
+                        {
+                            const XDGIcon *icon { manager.findIcon(name, size, scale, extensions, themes, contexts) };
+                            XDG_CHECK(query.find(name, size, scale) == icon);
+                            found += icon != nullptr;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    XDG_CHECK(found > 0);
+}
+
+XDG_TEST(lookupQueryReload)
+{
+    XDGTest::Fixture fixture;
+    writeThemes(fixture);
+    fixture.theme("XDGTestOtherParentTheme",
+        "[Icon Theme]\n"
+        "Name=Other parent\n"
+        "Comment=Test other parent\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+    fixture.icons("XDGTestOtherParentTheme", "32x32/apps", { "xdgtest-other-parent-only.png" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    XDGIconQuery query { manager, std::vector<std::string>{ "XDGTestChildTheme" }, XDGIcon::PNG };
+
+    XDG_CHECK(query.searchOrder().size() == 2);
+    XDG_CHECK(query.searchOrder()[0]->name() == "XDGTestChildTheme" && query.searchOrder()[1]->name() == "XDGTestParentTheme");
+    XDG_CHECK(query.find("xdgtest-parent-only", 32));
+    XDG_CHECK(!query.find("xdgtest-other-parent-only", 32));
+
+    // Kept alive so the replaced theme can't be reallocated at the same address
+    const std::shared_ptr<XDGIconTheme> child { manager.themes().find("XDGTestChildTheme")->second };
+
+    // The child now inherits the other parent (the modification time is advanced so the change is detected)
+    fixture.theme("XDGTestChildTheme",
+        "[Icon Theme]\n"
+        "Name=Child\n"
+        "Comment=Test child\n"
+        "Inherits=XDGTestOtherParentTheme\n"
+        "Directories=16x16/apps\n\n"
+        "[16x16/apps]\nSize=16\nType=Fixed\n");
+    const std::filesystem::path index { fixture.iconsDir() / "XDGTestChildTheme" / "index.theme" };
+    std::error_code ec;
+    std::filesystem::last_write_time(index, std::filesystem::last_write_time(index, ec) + std::chrono::seconds(1), ec);
+    XDG_CHECK(manager.reloadThemes());
+    XDG_CHECK(manager.themes().find("XDGTestChildTheme")->second != child);
+
+    // Rebuilt with the replaced theme and its new parent
+    const auto &order { query.searchOrder() };
+    XDG_CHECK(order.size() == 2);
+    XDG_CHECK(order[0] == manager.themes().find("XDGTestChildTheme")->second.get());
+    XDG_CHECK(order[1]->name() == "XDGTestOtherParentTheme");
+    XDG_CHECK(!query.find("xdgtest-parent-only", 32));
+    XDG_CHECK(query.find("xdgtest-other-parent-only", 32) == manager.findIcon("xdgtest-other-parent-only", 32, 1, XDGIcon::PNG,
+        std::vector<std::string>{ "XDGTestChildTheme" }));
+}
+
+XDG_TEST(lookupFindIconsMatchesFindIcon)
+{
+    XDGTest::Fixture fixture;
+    writeThemes(fixture);
+    fixture.theme("XDGTestSizesTheme",
+        "[Icon Theme]\n"
+        "Name=Sizes\n"
+        "Comment=Test sizes\n"
+        "Inherits=XDGTestChildTheme\n"
+        "Directories=16x16/apps,24x24/apps,48x48/apps,24x24@2/apps,scalable@2/apps,256x256/apps\n\n"
+        "[16x16/apps]\nSize=16\nType=Fixed\n\n"
+        "[24x24/apps]\nSize=24\nType=Threshold\nThreshold=4\n\n"
+        "[48x48/apps]\nSize=48\nType=Fixed\n\n"
+        "[24x24@2/apps]\nSize=24\nScale=2\nType=Fixed\n\n"
+        "[scalable@2/apps]\nSize=64\nScale=2\nMinSize=32\nMaxSize=128\nType=Scalable\n\n"
+        "[256x256/apps]\nSize=256\nType=Fixed\n");
+    fixture.icons("XDGTestSizesTheme", "16x16/apps", { "xdgtest-application.png", "xdgtest-sized.png" });
+    fixture.icons("XDGTestSizesTheme", "24x24/apps", { "xdgtest-sized.png" });
+    fixture.icons("XDGTestSizesTheme", "48x48/apps", { "xdgtest-application.png", "xdgtest-sized.png" });
+    fixture.icons("XDGTestSizesTheme", "24x24@2/apps", { "xdgtest-sized.png" });
+    fixture.icons("XDGTestSizesTheme", "scalable@2/apps", { "xdgtest-sized.svg", "xdgtest-application.svg" });
+    fixture.icons("XDGTestSizesTheme", "256x256/apps", { "xdgtest-sized.png" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    // More than MaxTargets, so they are resolved in several traversals
+    std::vector<XDGIconThemeManager::Target> targets;
+
+    for (int32_t scale : { 1, 2, 3 })
+        for (int32_t size : { 8, 16, 20, 22, 24, 28, 32, 48, 64, 96, 128, 512 })
+            targets.emplace_back(size, scale);
+
+    XDG_CHECK(targets.size() > XDGIconThemeManager::MaxTargets);
+
+    const std::vector<std::vector<std::string_view>> themeLists { { "XDGTestSizesTheme" }, { "XDGTestChildTheme" }, { "" } };
+    const char *names[] { "xdgtest-sized", "xdgtest-application", "xdgtest-vector-only", "xdgtest-missing-icon" };
+    const uint32_t extensionSets[] { XDGIcon::PNG, XDGIcon::SVG, XDGIcon::PNG | XDGIcon::SVG };
+    std::vector<const XDGIcon*> icons(targets.size());
+
+    for (const auto &themes : themeLists)
+    {
+        for (uint32_t extensions : extensionSets)
+        {
+            for (const char *name : names)
+            {
+                std::fill(icons.begin(), icons.end(), nullptr);
+                const size_t found { manager.findIcons(targets, icons, name, extensions, themes) };
+                size_t expected { 0 };
+
+                for (size_t i = 0; i < targets.size(); i++)
+                {
+                    const XDGIcon *icon { manager.findIcon(name, targets[i].size, targets[i].scale, extensions, themes) };
+                    XDG_CHECK(icons[i] == icon);
+                    expected += icon != nullptr;
+                }
+
+                XDG_CHECK(found == expected);
+            }
+        }
+    }
+
+    // Only as many targets as the buffer holds are resolved
+    const std::vector<std::string_view> themes { "XDGTestSizesTheme" };
+    std::fill(icons.begin(), icons.end(), nullptr);
+    const size_t found { manager.findIcons(targets, std::span(icons).first(20), "xdgtest-sized", XDGIcon::PNG, themes) };
+    XDG_CHECK(found == 20);
+    XDG_CHECK(std::all_of(icons.begin(), icons.begin() + 20, [](const XDGIcon *icon) { return icon != nullptr; }));
+    XDG_CHECK(std::all_of(icons.begin() + 20, icons.end(), [](const XDGIcon *icon) { return icon == nullptr; }));
+}
+
+XDG_TEST(lookupFractionalScale)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestFractionalTheme",
+        "[Icon Theme]\n"
+        "Name=Fractional\n"
+        "Comment=Test fractional scales\n"
+        "Directories=32x32/apps,64x64/apps,24x24/apps,24x24@2/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n\n"
+        "[64x64/apps]\nSize=64\nType=Fixed\n\n"
+        "[24x24/apps]\nSize=24\nType=Fixed\n\n"
+        "[24x24@2/apps]\nSize=24\nScale=2\nType=Fixed\n");
+    fixture.icons("XDGTestFractionalTheme", "32x32/apps", { "xdgtest-fractional.png" });
+    fixture.icons("XDGTestFractionalTheme", "64x64/apps", { "xdgtest-fractional.png" });
+    fixture.icons("XDGTestFractionalTheme", "24x24/apps", { "xdgtest-scaled.png" });
+    fixture.icons("XDGTestFractionalTheme", "24x24@2/apps", { "xdgtest-scaled.png" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view themes[] { "XDGTestFractionalTheme" };
+
+    // The requested size (32 px) upscaled costs twice the missing pixels, 64 px downscaled costs the extra ones
+    const auto dirName { [&](std::string_view icon, int32_t size, double scale) -> std::string_view {
+        const XDGIcon *found { manager.findIconFractional(icon, size, scale, XDGIcon::PNG, themes) };
+        return found ? found->directory().dirName() : std::string_view {}; } };
+
+    // 40 px: 2 * 8 < 24
+    XDG_CHECK(dirName("xdgtest-fractional", 32, 1.25) == "32x32/apps");
+    // 48 px: 2 * 16 > 16
+    XDG_CHECK(dirName("xdgtest-fractional", 32, 1.5) == "64x64/apps");
+    // 56 px: 2 * 24 > 8
+    XDG_CHECK(dirName("xdgtest-fractional", 32, 1.75) == "64x64/apps");
+
+    // Same with the scale of the directories: 24@1 provides 24 px and 24@2 provides 48 px
+    // 30 px: 2 * 6 < 18
+    XDG_CHECK(dirName("xdgtest-scaled", 24, 1.25) == "24x24/apps");
+    // 36 px: 2 * 12 > 12
+    XDG_CHECK(dirName("xdgtest-scaled", 24, 1.5) == "24x24@2/apps");
+    // 42 px: 2 * 18 > 6
+    XDG_CHECK(dirName("xdgtest-scaled", 24, 1.75) == "24x24@2/apps");
+
+    // Integer scales still prefer the exact directory
+    XDG_CHECK(dirName("xdgtest-fractional", 32, 1.0) == "32x32/apps");
+    XDG_CHECK(dirName("xdgtest-scaled", 24, 2.0) == "24x24@2/apps");
+}
+
+static void checkSymbolic(XDGIconThemeManager &manager, bool usingCache) noexcept
+{
+    const std::string_view themes[] { "XDGTestSymbolicTheme" };
+
+    // The symbolic variant wins within a theme
+    const XDGIcon *icon { manager.findSymbolicIcon("xdgtest-view", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes) };
+    XDG_CHECK(icon && icon->name() == "xdgtest-view-symbolic" && icon->symbolic());
+    XDG_CHECK(icon && icon->directory().theme().name() == "XDGTestSymbolicTheme");
+    XDG_CHECK(icon && icon->usingCache() == usingCache);
+
+    // Also if the name already has the suffix
+    XDG_CHECK(manager.findSymbolicIcon("xdgtest-view-symbolic", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes) == icon);
+
+    // Unless the format isn't accepted
+    icon = manager.findSymbolicIcon("xdgtest-view", 32, 1, XDGIcon::PNG, themes);
+    XDG_CHECK(icon && icon->name() == "xdgtest-view" && !icon->symbolic());
+
+    // A regular icon in an earlier theme beats a symbolic one in an inherited theme
+    icon = manager.findSymbolicIcon("xdgtest-edit", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes);
+    XDG_CHECK(icon && icon->name() == "xdgtest-edit" && !icon->symbolic());
+    XDG_CHECK(icon && icon->directory().theme().name() == "XDGTestSymbolicTheme");
+
+    // Only available as symbolic in the inherited theme
+    icon = manager.findSymbolicIcon("xdgtest-find", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes);
+    XDG_CHECK(icon && icon->name() == "xdgtest-find-symbolic" && icon->symbolic());
+    XDG_CHECK(icon && icon->directory().theme().name() == "XDGTestSymbolicParentTheme");
+
+    // The flag is set for symbolic icons found by findIcon() too
+    icon = manager.findIcon("xdgtest-find-symbolic", 32, 1, XDGIcon::SVG, themes);
+    XDG_CHECK(icon && icon->symbolic());
+    XDG_CHECK(!manager.findSymbolicIcon("xdgtest-missing-icon", 32, 1, XDGIcon::PNG | XDGIcon::SVG, themes));
+}
+
+// Adds directories with distinct sizes, themes with more than MaxSizeClasses size classes are searched via XDGIconTheme::index()
+static void writeFillerTheme(XDGTest::Fixture &fixture, std::string_view theme, std::string_view index, size_t count) noexcept
+{
+    std::string dirs, sections;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const std::string dir { "filler/" + std::to_string(i) };
+        dirs += "," + dir;
+        sections += "\n[" + dir + "]\nSize=" + std::to_string(100 + i) + "\nType=Fixed\n";
+        fixture.icons(theme, dir, { "xdgtest-filler.png" });
+    }
+
+    std::string out { index };
+    out.insert(out.find('\n', out.find("Directories=")), dirs);
+    fixture.theme(theme, out + sections);
+}
+
+XDG_TEST(lookupSymbolic)
+{
+    for (const size_t filler : { 0, 80 })
+    {
+        XDGTest::Fixture fixture;
+        writeFillerTheme(fixture, "XDGTestSymbolicTheme",
+            "[Icon Theme]\n"
+            "Name=Symbolic\n"
+            "Comment=Test symbolic\n"
+            "Inherits=XDGTestSymbolicParentTheme\n"
+            "Directories=32x32/apps,symbolic/apps\n\n"
+            "[32x32/apps]\nSize=32\nType=Fixed\n\n"
+            "[symbolic/apps]\nSize=16\nMinSize=8\nMaxSize=512\nType=Scalable\n", filler);
+        fixture.icons("XDGTestSymbolicTheme", "32x32/apps", { "xdgtest-view.png", "xdgtest-edit.png" });
+        fixture.icons("XDGTestSymbolicTheme", "symbolic/apps", { "xdgtest-view-symbolic.svg" });
+        writeFillerTheme(fixture, "XDGTestSymbolicParentTheme",
+            "[Icon Theme]\n"
+            "Name=Symbolic parent\n"
+            "Comment=Test symbolic parent\n"
+            "Directories=symbolic/apps\n\n"
+            "[symbolic/apps]\nSize=16\nMinSize=8\nMaxSize=512\nType=Scalable\n", filler);
+        fixture.icons("XDGTestSymbolicParentTheme", "symbolic/apps", { "xdgtest-edit-symbolic.svg", "xdgtest-find-symbolic.svg" });
+
+        {
+            XDGKit::Options options;
+            options.useIconThemesCache = false;
+            auto kit { XDGKit::Make(options) };
+            checkSymbolic(kit->iconThemeManager(), false);
+            XDG_CHECK(kit->iconThemeManager().themes().find("XDGTestSymbolicTheme")->second->sizeClasses().size() > filler);
+        }
+
+        if (!fixture.cache({ "XDGTestSymbolicTheme", "XDGTestSymbolicParentTheme" }))
+            XDG_SKIP("the system cache directory is not writable");
+
+        XDGKit::Options options;
+        options.autoReloadCache = false;
+        auto kit { XDGKit::Make(options) };
+        checkSymbolic(kit->iconThemeManager(), true);
+    }
+}
+
+// Same icon and directory, the themes being different
+static bool sameIcon(const XDGIcon *a, const XDGIcon *b) noexcept
+{
+    if (!a || !b)
+        return a == b;
+
+    return a->name() == b->name() && a->directory().dirName() == b->directory().dirName();
+}
+
+static void checkAvailabilityMatchesIndex(XDGIconThemeManager &manager, size_t &found) noexcept
+{
+    const std::string_view availabilityTheme[] { "XDGTestAvailabilityTheme" };
+    const std::string_view indexTheme[] { "XDGTestIndexTheme" };
+    const uint32_t extensionSets[] { XDGIcon::PNG, XDGIcon::SVG, XDGIcon::XPM, XDGIcon::PNG | XDGIcon::SVG | XDGIcon::XPM };
+    const uint32_t contextSets[] { XDGIconDirectory::AnyContext, XDGIconDirectory::NoContext, XDGIconDirectory::Actions | XDGIconDirectory::Devices };
+
+    // The index path is only taken past MaxSizeClasses
+    manager.findIcon("xdgtest-random-0", 32, 1, XDGIcon::PNG, availabilityTheme);
+    manager.findIcon("xdgtest-random-0", 32, 1, XDGIcon::PNG, indexTheme);
+    XDG_CHECK(!manager.themes().find("XDGTestAvailabilityTheme")->second->iconAvailability().empty());
+    XDG_CHECK(manager.themes().find("XDGTestIndexTheme")->second->iconAvailability().empty());
+
+    for (int i = 0; i <= 8; i++)
+    {
+        const std::string name { "xdgtest-random-" + std::to_string(i) };
+
+        for (uint32_t extensions : extensionSets)
+        {
+            for (uint32_t contexts : contextSets)
+            {
+                for (int32_t size : { 8, 16, 24, 30, 48, 64, 96, 256 })
+                {
+                    for (int32_t scale : { 1, 2 })
+                    {
+                        const XDGIcon *icon { manager.findIcon(name, size, scale, extensions, availabilityTheme, contexts) };
+                        XDG_CHECK(sameIcon(icon, manager.findIcon(name, size, scale, extensions, indexTheme, contexts)));
+                        XDG_CHECK(sameIcon(manager.findSymbolicIcon(name, size, scale, extensions, availabilityTheme, contexts),
+                                           manager.findSymbolicIcon(name, size, scale, extensions, indexTheme, contexts)));
+                        found += icon != nullptr;
+                    }
+
+                    for (double scale : { 1.25, 1.5 })
+                        XDG_CHECK(sameIcon(manager.findIconFractional(name, size, scale, extensions, availabilityTheme, contexts),
+                                           manager.findIconFractional(name, size, scale, extensions, indexTheme, contexts)));
+                }
+            }
+        }
+    }
+}
+
+XDG_TEST(lookupAvailabilityMatchesIndex)
+{
+    // The same random directories, searched via the availability bitmaps and via the directory index
+    std::mt19937 rng { 35 };
+    const char *types[] { "Fixed", "Scalable", "Threshold" };
+    const char *contexts[] { "", "Actions", "Devices" };
+    const char *extensions[] { ".png", ".svg", ".xpm" };
+    const int32_t sizes[] { 16, 22, 24, 32, 48, 64, 96 };
+    bool cached { true };
+
+    for (int round = 0; round < 6; round++)
+    {
+        XDGTest::Fixture fixture;
+        std::string dirs, sections;
+        std::vector<std::pair<std::string, std::vector<std::string>>> files;
+
+        for (int d = 0; d < 14; d++)
+        {
+            const std::string dir { "dir" + std::to_string(d) };
+            const int32_t size { sizes[rng() % std::size(sizes)] };
+            const char *type { types[rng() % std::size(types)] };
+            const char *context { contexts[rng() % std::size(contexts)] };
+            dirs += (d ? "," : "") + dir;
+            sections += "\n[" + dir + "]\nSize=" + std::to_string(size) + "\nScale=" + std::to_string(1 + rng() % 2) + "\nType=" + type + "\n";
+
+            if (*context)
+                sections += std::string("Context=") + context + "\n";
+
+            if (std::string_view(type) == "Scalable")
+                sections += "MinSize=" + std::to_string(size / 2) + "\nMaxSize=" + std::to_string(size * 4) + "\n";
+
+            auto &dirFiles { files.emplace_back(dir, std::vector<std::string> {}).second };
+
+            // Regular and symbolic names, each with one or more formats
+            for (int i = 0; i < 8; i++)
+            {
+                for (const char *suffix : { "", "-symbolic" })
+                {
+                    if (rng() % 3 != 0)
+                        continue;
+
+                    for (const char *ext : extensions)
+                        if (rng() % 2 == 0)
+                            dirFiles.emplace_back("xdgtest-random-" + std::to_string(i) + suffix + ext);
+                }
+            }
+        }
+
+        const std::string index { "[Icon Theme]\nName=Random\nComment=Test random\nDirectories=" + dirs + "\n" + sections };
+
+        for (const char *theme : { "XDGTestAvailabilityTheme", "XDGTestIndexTheme" })
+        {
+            writeFillerTheme(fixture, theme, index, std::string_view(theme) == "XDGTestIndexTheme" ? 80 : 0);
+
+            for (const auto &[dir, dirFiles] : files)
+            {
+                fixture.icons(theme, dir, {});
+
+                for (const auto &file : dirFiles)
+                    fixture.icons(theme, dir, { file });
+            }
+        }
+
+        size_t found { 0 };
+
+        {
+            XDGKit::Options options;
+            options.useIconThemesCache = false;
+            auto kit { XDGKit::Make(options) };
+            checkAvailabilityMatchesIndex(kit->iconThemeManager(), found);
+        }
+
+        XDG_CHECK(found > 0);
+
+        // Availability loaded from the cache
+        if (!cached || !fixture.cache({ "XDGTestAvailabilityTheme", "XDGTestIndexTheme" }))
+        {
+            cached = false;
+            continue;
+        }
+
+        XDGKit::Options options;
+        options.autoReloadCache = false;
+        auto kit { XDGKit::Make(options) };
+        checkAvailabilityMatchesIndex(kit->iconThemeManager(), found);
+    }
+
+    if (!cached)
+        XDG_SKIP("the system cache directory is not writable");
+}
@@ -0,0 +1,37 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <memory>
+
+using namespace CZ;
+
+XDG_TEST(manifestOutlivesKit)
+{
+    XDGTest::Fixture fixture;
+    fixture.theme("XDGTestManifestTheme",
+        "[Icon Theme]\n"
+        "Name=Manifest\n"
+        "Comment=Test manifest\n"
+        "Directories=32x32/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n");
+    fixture.icons("XDGTestManifestTheme", "32x32/apps", { "xdgtest-manifest.png" });
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    const std::vector<std::string> themes { "XDGTestManifestTheme" };
+    auto manifest { std::make_unique<XDGIconManifest>(kit->iconThemeManager(), themes, XDGIcon::PNG) };
+    auto destroyed { std::make_unique<XDGIconManifest>(kit->iconThemeManager(), themes, XDGIcon::PNG) };
+
+    const uint32_t entry { manifest->add("xdgtest-manifest", 32) };
+    XDG_CHECK(manifest->icon(entry));
+
+    // Unregistered before the kit
+    destroyed.reset();
+
+    // Detached when the kit is destroyed first
+    kit.reset();
+    XDG_CHECK(!manifest->icon(entry));
+    XDG_CHECK(!manifest->icon(manifest->add("xdgtest-manifest", 32)));
+    XDG_CHECK(manifest->size() == 2);
+    manifest.reset();
+}
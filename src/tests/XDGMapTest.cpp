@@ -0,0 +1,236 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGMap.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+using namespace CZ;
+
+// Counts live instances to detect leaked or double destroyed elements
+struct Tracked
+{
+    static inline int live { 0 };
+    int value { 0 };
+
+    Tracked(int value = 0) noexcept : value(value) { live++; }
+    Tracked(const Tracked &other) noexcept : value(other.value) { live++; }
+    Tracked(Tracked &&other) noexcept : value(other.value) { live++; }
+    Tracked &operator=(const Tracked &) noexcept = default;
+    ~Tracked() { live--; }
+};
+
+XDG_TEST(mapMatchesUnorderedMap)
+{
+    {
+        XDGMap<std::string, Tracked> map;
+        std::unordered_map<std::string, int> ref;
+
+        // Inserts and erases interleaved so tombstones are reused and the table is rehashed in place
+        for (int i = 0; i < 20000; i++)
+        {
+            const std::string key { "key" + std::to_string((i * 7919) % 3000) };
+
+            if (i % 3 == 2)
+                XDG_CHECK(map.erase(key) == ref.erase(key));
+            else
+            {
+                const bool inserted { map.try_emplace(key, i).second };
+                XDG_CHECK(inserted == ref.try_emplace(key, i).second);
+            }
+        }
+
+        XDG_CHECK(map.size() == ref.size());
+        XDG_CHECK(Tracked::live == (int)map.size());
+
+        size_t count { 0 };
+
+        for (const auto &[key, value] : map)
+        {
+            const auto it { ref.find(key) };
+            XDG_CHECK(it != ref.end() && it->second == value.value);
+            count++;
+        }
+
+        XDG_CHECK(count == ref.size());
+
+        for (const auto &[key, value] : ref)
+        {
+            const auto it { map.find(key) };
+            XDG_CHECK(it != map.end() && it->second.value == value);
+        }
+
+        // Copies and moves keep every element
+        XDGMap<std::string, Tracked> copy { map };
+        XDG_CHECK(copy.size() == map.size());
+        XDGMap<std::string, Tracked> moved { std::move(copy) };
+        XDG_CHECK(moved.size() == map.size() && copy.empty());
+        XDG_CHECK(Tracked::live == 2 * (int)map.size());
+
+        // Erasing through iterators visits every element once
+        count = 0;
+
+        for (auto it = moved.begin(); it != moved.end();)
+        {
+            it = moved.erase(it);
+            count++;
+        }
+
+        XDG_CHECK(count == map.size() && moved.empty());
+    }
+
+    XDG_CHECK(Tracked::live == 0);
+}
+
+XDG_TEST(mapTransparentKeys)
+{
+    XDGMap<std::string, int> map;
+    map["alpha"] = 1;
+    map.emplace(std::string_view("beta"), 2);
+    map.try_emplace("gamma", 3);
+
+    const std::string_view view { "beta" };
+    const char *cstr { "gamma" };
+
+    XDG_CHECK(map.contains(view) && map.find(view)->second == 2);
+    XDG_CHECK(map.contains(cstr) && map.find(cstr)->second == 3);
+    XDG_CHECK(map.count("alpha") == 1 && map.count("delta") == 0);
+
+    XDG_CHECK(map.erase(view) == 1);
+    XDG_CHECK(map.erase(cstr) == 1);
+    XDG_CHECK(map.erase("delta") == 0);
+    XDG_CHECK(map.size() == 1 && map.contains("alpha") && !map.contains(view));
+}
+
+XDG_TEST(mapSlots)
+{
+    XDGMap<std::string, int> map;
+
+    for (int i = 0; i < 100; i++)
+        map.emplace(std::to_string(i), i);
+
+    const auto it { map.find("42") };
+    const size_t slot { map.slotOf(it) };
+    XDG_CHECK(map.atSlot(slot) == it);
+    XDG_CHECK(map.atSlot(map.capacity()) == map.end());
+
+    map.erase("42");
+    XDG_CHECK(map.atSlot(slot) == map.end());
+}
+
+// Element constructed from a flag that makes the constructor throw
+struct ThrowOnConstruct
+{
+    ThrowOnConstruct(bool fail)
+    {
+        if (fail)
+            throw std::runtime_error("ThrowOnConstruct");
+    }
+};
+
+XDG_TEST(mapExceptionSafety)
+{
+    // A failed rehash allocation leaves the map unchanged
+    XDGMap<std::string, Tracked> map;
+    size_t failures { 0 };
+
+    for (int i = 0; i < 2000; i++)
+    {
+        // Short keys (no heap allocation), so the only allocation is the table
+        const std::string key { std::to_string(i) };
+        const size_t size { map.size() };
+        const size_t capacity { map.capacity() };
+
+        XDGTest::failAllocation(1);
+
+        try
+        {
+            map.try_emplace(key, i);
+        }
+        catch (const std::bad_alloc &)
+        {
+            failures++;
+            XDG_CHECK(map.size() == size && map.capacity() == capacity);
+            XDG_CHECK(!map.contains(key));
+            XDG_CHECK(Tracked::live == (int)size);
+
+            for (int j = 0; j < i; j++)
+            {
+                const auto it { map.find(std::to_string(j)) };
+                XDG_CHECK(it != map.end() && it->second.value == j);
+            }
+
+            XDGTest::failAllocation(0);
+            map.try_emplace(key, i);
+        }
+
+        XDGTest::failAllocation(0);
+    }
+
+    XDG_CHECK(failures > 5);
+    XDG_CHECK(map.size() == 2000);
+    map.clear();
+    XDG_CHECK(Tracked::live == 0);
+
+    // A throwing constructor doesn't leave a used slot behind
+    XDGMap<std::string, ThrowOnConstruct> throwing;
+    throwing.try_emplace("ok", false);
+
+    try
+    {
+        throwing.try_emplace("fail", true);
+        XDG_CHECK(false);
+    }
+    catch (const std::runtime_error &) {}
+
+    XDG_CHECK(throwing.size() == 1 && !throwing.contains("fail"));
+
+    size_t count { 0 };
+
+    for (auto it = throwing.begin(); it != throwing.end(); it++)
+        count++;
+
+    XDG_CHECK(count == 1);
+    XDG_CHECK(throwing.try_emplace("fail", false).second);
+
+    // A copy failing at any allocation destroys the elements copied so far and frees its table
+    XDGMap<std::string, Tracked> source;
+
+    for (int i = 0; i < 200; i++)
+        source.try_emplace("long enough to be heap allocated " + std::to_string(i), i);
+
+    // Tombstones must be copied too
+    for (int i = 0; i < 200; i += 3)
+        source.erase("long enough to be heap allocated " + std::to_string(i));
+
+    const int live { Tracked::live };
+    bool copied { false };
+
+    for (size_t n = 1; !copied; n++)
+    {
+        XDGTest::failAllocation(n);
+
+        try
+        {
+            XDGMap<std::string, Tracked> copy { source };
+            XDGTest::failAllocation(0);
+            copied = true;
+            XDG_CHECK(n > source.size());
+            XDG_CHECK(copy.size() == source.size() && Tracked::live == 2 * live);
+
+            for (int i = 0; i < 200; i++)
+            {
+                const auto it { copy.find("long enough to be heap allocated " + std::to_string(i)) };
+                XDG_CHECK((it != copy.end()) == (i % 3 != 0));
+                XDG_CHECK(it == copy.end() || it->second.value == i);
+            }
+        }
+        catch (const std::bad_alloc &)
+        {
+            XDGTest::failAllocation(0);
+            XDG_CHECK(Tracked::live == live);
+        }
+    }
+
+    XDG_CHECK(source.size() == 133 && Tracked::live == live);
+}
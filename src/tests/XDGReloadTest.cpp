@@ -0,0 +1,122 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <chrono>
+
+using namespace CZ;
+
+static void writeTheme(XDGTest::Fixture &fixture, std::string_view theme) noexcept
+{
+    fixture.theme(theme,
+        "[Icon Theme]\n"
+        "Name=Reload\n"
+        "Comment=Test reload\n"
+        "Directories=32x32/apps,48x48/apps\n\n"
+        "[32x32/apps]\nSize=32\nType=Fixed\n\n"
+        "[48x48/apps]\nSize=48\nType=Fixed\n");
+    fixture.icons(theme, "32x32/apps", { "xdgtest-reloaded.png", "xdgtest-removed.png" });
+    fixture.icons(theme, "48x48/apps", { "xdgtest-reloaded.png" });
+}
+
+// Modification times have a coarse resolution, changes are made visible explicitly
+static void touch(const std::filesystem::path &path) noexcept
+{
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path, ec) + std::chrono::seconds(1), ec);
+}
+
+XDG_TEST(reloadResolvesHandles)
+{
+    XDGTest::Fixture fixture;
+    writeTheme(fixture, "XDGTestChangedTheme");
+    writeTheme(fixture, "XDGTestStableTheme");
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const std::string_view changed[] { "XDGTestChangedTheme" };
+    const std::string_view stable[] { "XDGTestStableTheme" };
+
+    XDG_CHECK(!manager.makeHandle(nullptr));
+
+    const XDGIcon *stableIcon { manager.findIcon("xdgtest-reloaded", 32, 1, XDGIcon::PNG, stable) };
+    const XDGIcon *icon { manager.findIcon("xdgtest-reloaded", 48, 1, XDGIcon::PNG, changed) };
+    const XDGIcon *removed { manager.findIcon("xdgtest-removed", 32, 1, XDGIcon::PNG, changed) };
+    XDG_CHECK(stableIcon && icon && removed);
+
+    XDGIconHandle stableHandle { manager.makeHandle(stableIcon) };
+    XDGIconHandle handle { manager.makeHandle(icon) };
+    XDGIconHandle removedHandle { manager.makeHandle(removed) };
+    XDG_CHECK(manager.isCurrent(handle) && manager.resolve(handle) == icon);
+
+    const std::filesystem::path dir { fixture.iconsDir() / "XDGTestChangedTheme" / "32x32/apps" };
+    std::filesystem::remove(dir / "xdgtest-removed.png");
+    touch(dir);
+    XDG_CHECK(manager.reloadThemes());
+
+    // The unchanged theme is kept, so its handles stay current
+    XDG_CHECK(manager.isCurrent(stableHandle));
+    XDG_CHECK(manager.resolve(stableHandle) == stableIcon);
+
+    // Handles to the replaced theme are looked up by name in the directory with the same name
+    XDG_CHECK(!manager.isCurrent(handle));
+    icon = manager.resolve(handle);
+    XDG_CHECK(icon && icon->name() == "xdgtest-reloaded" && icon->directory().dirName() == "48x48/apps");
+    XDG_CHECK(icon && &icon->directory().theme() == manager.themes().find("XDGTestChangedTheme")->second.get());
+    XDG_CHECK(manager.isCurrent(handle));
+    XDG_CHECK(manager.resolve(handle) == icon);
+
+    // And invalidated once the icon is gone
+    XDG_CHECK(!manager.resolve(removedHandle));
+    XDG_CHECK(!removedHandle);
+}
+
+XDG_TEST(reloadOnlyChangedThemes)
+{
+    XDGTest::Fixture fixture;
+    writeTheme(fixture, "XDGTestChangedTheme");
+    writeTheme(fixture, "XDGTestStableTheme");
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    const auto &themes { manager.themes() };
+
+    // Loads the directories, which are compared from now on
+    XDG_CHECK(!manager.findIcon("xdgtest-missing-icon", 32, 1, XDGIcon::PNG));
+
+    const uint64_t generation { manager.generation() };
+    // Kept alive so replaced themes can't be reallocated at the same address
+    std::shared_ptr<XDGIconTheme> changed { themes.find("XDGTestChangedTheme")->second };
+    const std::shared_ptr<XDGIconTheme> stable { themes.find("XDGTestStableTheme")->second };
+
+    XDG_CHECK(!manager.reloadThemes());
+    XDG_CHECK(manager.generation() == generation);
+    XDG_CHECK(themes.find("XDGTestChangedTheme")->second == changed);
+
+    // Adding an icon to a listed directory replaces only that theme
+    const std::filesystem::path dir { fixture.iconsDir() / "XDGTestChangedTheme" / "48x48/apps" };
+    fixture.icons("XDGTestChangedTheme", "48x48/apps", { "xdgtest-added.png" });
+    touch(dir);
+    XDG_CHECK(manager.reloadThemes());
+    XDG_CHECK(manager.generation() == generation + 1);
+    XDG_CHECK(themes.find("XDGTestStableTheme")->second == stable);
+    XDG_CHECK(themes.find("XDGTestChangedTheme")->second != changed);
+    XDG_CHECK(manager.findIcon("xdgtest-added", 48, 1, XDGIcon::PNG, std::vector<std::string>{ "XDGTestChangedTheme" }));
+
+    // New themes are added without touching the others
+    changed = themes.find("XDGTestChangedTheme")->second;
+    writeTheme(fixture, "XDGTestAddedTheme");
+    XDG_CHECK(manager.reloadThemes());
+    XDG_CHECK(themes.find("XDGTestAddedTheme") != themes.end());
+    XDG_CHECK(themes.find("XDGTestChangedTheme")->second == changed);
+    XDG_CHECK(themes.find("XDGTestStableTheme")->second == stable);
+
+    // And removed themes are dropped
+    std::filesystem::remove_all(fixture.iconsDir() / "XDGTestAddedTheme");
+    XDG_CHECK(manager.reloadThemes());
+    XDG_CHECK(themes.find("XDGTestAddedTheme") == themes.end());
+    XDG_CHECK(themes.find("XDGTestStableTheme")->second == stable);
+    XDG_CHECK(!manager.reloadThemes());
+}
@@ -0,0 +1,77 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGSizeBatch.h>
+#include <random>
+
+using namespace CZ;
+
+static XDGIconDirectory::Cache randomDir(std::mt19937 &rng) noexcept
+{
+    // Includes invalid size types, which must get the same distance in every implementation
+    static constexpr uint32_t sizeTypes[] { XDGIconDirectory::Fixed, XDGIconDirectory::Scalable, XDGIconDirectory::Threshold, 0, 8 };
+    std::uniform_int_distribution<int32_t> size { 1, 512 }, scale { 1, 3 }, threshold { 0, 8 };
+    std::uniform_int_distribution<size_t> type { 0, std::size(sizeTypes) - 1 };
+    XDGIconDirectory::Cache dir {};
+
+    dir.sizeType = static_cast<XDGIconDirectory::SizeType>(sizeTypes[type(rng)]);
+    dir.size = size(rng);
+    dir.minSize = size(rng);
+    dir.maxSize = size(rng);
+    dir.scale = scale(rng);
+    dir.threshold = threshold(rng);
+
+    // Mostly valid ranges, some inverted ones
+    if (dir.minSize > dir.maxSize && rng() % 4 != 0)
+        std::swap(dir.minSize, dir.maxSize);
+
+    return dir;
+}
+
+XDG_TEST(sizeBatchMatchesScalar)
+{
+    std::mt19937 rng { 1234 };
+    std::uniform_int_distribution<uint32_t> count { 1, XDGSizeBatch::Capacity };
+    std::uniform_int_distribution<int32_t> size { 1, 600 }, scale { 1, 3 };
+    std::vector<XDGIconDirectory::Cache> dirs;
+    XDGSizeBatch batch;
+
+    for (int round = 0; round < 2000; round++)
+    {
+        // Random counts cover the scalar tails of the SIMD loops
+        dirs.clear();
+        batch.clear();
+
+        for (uint32_t i = count(rng); i > 0; i--)
+        {
+            dirs.emplace_back(randomDir(rng));
+            XDG_CHECK(batch.push(dirs.back()));
+        }
+
+        const int32_t querySize { size(rng) };
+        const int32_t queryScale { scale(rng) };
+
+        for (auto impl : { XDGSizeBatch::Scalar, XDGSizeBatch::SSE41, XDGSizeBatch::AVX2 })
+        {
+            batch.score(querySize, queryScale, impl);
+
+            for (uint32_t i = 0; i < batch.size(); i++)
+            {
+                XDG_CHECK(batch.matches(i) == XDGSizeBatch::MatchesSize(dirs[i], querySize, queryScale));
+                XDG_CHECK(batch.distance(i) == XDGSizeBatch::SizeDistance(dirs[i], querySize * queryScale));
+            }
+        }
+    }
+}
+
+XDG_TEST(sizeBatchCapacity)
+{
+    XDGSizeBatch batch;
+    XDGIconDirectory::Cache dir {};
+
+    for (uint32_t i = 0; i < XDGSizeBatch::Capacity; i++)
+        XDG_CHECK(batch.push(dir));
+
+    XDG_CHECK(batch.full());
+    XDG_CHECK(!batch.push(dir));
+    batch.clear();
+    XDG_CHECK(batch.empty());
+}
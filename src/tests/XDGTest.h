@@ -0,0 +1,87 @@
+#ifndef XDGTEST_H
+#define XDGTEST_H
+
+#include <cstddef>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Minimal test registry for cz-xdgkit-tests.
+ *
+ * Each XDG_TEST() registers itself at startup and main.cpp runs them in registration order,
+ * or only the ones whose name contains argv[1].
+ */
+namespace CZ::XDGTest
+{
+    struct Case
+    {
+        const char *name;
+        void (*run)();
+    };
+
+    std::vector<Case> &cases() noexcept;
+
+    struct Register
+    {
+        Register(const char *name, void (*run)()) noexcept
+        {
+            cases().emplace_back(name, run);
+        }
+    };
+
+    // Marks the running test as failed
+    void fail(const char *file, int line, const char *expr) noexcept;
+
+    // Marks the running test as skipped (e.g. missing permissions)
+    void skip(const char *reason) noexcept;
+
+    // Calls to the global operator new made by any thread since startup
+    size_t allocations() noexcept;
+
+    // Makes the n-th next call to the global operator new throw std::bad_alloc, 0 to disable
+    void failAllocation(size_t n) noexcept;
+
+    // Icon themes written to a temporary data dir, which is the only XDG_DATA_DIRS entry while alive
+    class Fixture
+    {
+    public:
+        Fixture() noexcept;
+        ~Fixture();
+
+        // Writes <dir>/icons/<theme>/index.theme
+        void theme(std::string_view theme, std::string_view index) noexcept;
+
+        // Creates empty icon files in <dir>/icons/<theme>/<subdir>
+        void icons(std::string_view theme, std::string_view subdir, std::initializer_list<std::string_view> files) noexcept;
+
+        // <dir>/icons
+        const std::filesystem::path &iconsDir() const noexcept { return m_iconsDir; }
+
+        // Writes the system cache files of the themes like the indexer does, removed by the destructor
+        // Returns false if the cache directory is not writable
+        bool cache(std::initializer_list<std::string_view> themes) noexcept;
+
+    private:
+        std::filesystem::path m_dir, m_iconsDir;
+        std::vector<std::filesystem::path> m_cacheFiles;
+        std::filesystem::path m_createdCacheDir;
+        std::string m_prevDataDirs;
+        bool m_hadDataDirs { false };
+    };
+}
+
+#define XDG_TEST(name) \
+    static void name(); \
+    static const CZ::XDGTest::Register name##Register { #name, name }; \
+    static void name()
+
+#define XDG_CHECK(expr) \
+    do { if (!(expr)) CZ::XDGTest::fail(__FILE__, __LINE__, #expr); } while (0)
+
+#define XDG_SKIP(reason) \
+    do { CZ::XDGTest::skip(reason); return; } while (0)
+
+#endif // XDGTEST_H
@@ -0,0 +1,108 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+using namespace CZ;
+
+XDGTest::Fixture::Fixture() noexcept
+{
+    char dir[] { "/tmp/xdgkit-test-XXXXXX" };
+
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        abort();
+    }
+
+    m_dir = dir;
+    m_iconsDir = m_dir / "icons";
+    std::filesystem::create_directories(m_iconsDir);
+
+    if (const char *env = getenv("XDG_DATA_DIRS"))
+    {
+        m_hadDataDirs = true;
+        m_prevDataDirs = env;
+    }
+
+    setenv("XDG_DATA_DIRS", m_dir.c_str(), 1);
+}
+
+XDGTest::Fixture::~Fixture()
+{
+    if (m_hadDataDirs)
+        setenv("XDG_DATA_DIRS", m_prevDataDirs.c_str(), 1);
+    else
+        unsetenv("XDG_DATA_DIRS");
+
+    std::error_code ec;
+    std::filesystem::remove_all(m_dir, ec);
+
+    for (const auto &file : m_cacheFiles)
+        std::filesystem::remove(file, ec);
+
+    if (!m_createdCacheDir.empty())
+        std::filesystem::remove_all(m_createdCacheDir, ec);
+}
+
+void XDGTest::Fixture::theme(std::string_view theme, std::string_view index) noexcept
+{
+    const std::filesystem::path dir { m_iconsDir / theme };
+    std::filesystem::create_directories(dir);
+    std::ofstream file { dir / "index.theme" };
+    file << index;
+}
+
+void XDGTest::Fixture::icons(std::string_view theme, std::string_view subdir, std::initializer_list<std::string_view> files) noexcept
+{
+    const std::filesystem::path dir { m_iconsDir / theme / subdir };
+    std::filesystem::create_directories(dir);
+
+    for (const auto &file : files)
+        std::ofstream { dir / file };
+}
+
+bool XDGTest::Fixture::cache(std::initializer_list<std::string_view> themes) noexcept
+{
+    const std::filesystem::path cacheDir { "/var/cache/xdgkit/icon_themes/system" };
+    std::error_code ec;
+
+    // Only the directories that didn't exist are removed afterwards
+    if (m_createdCacheDir.empty())
+    {
+        std::filesystem::path created { cacheDir };
+
+        while (!created.parent_path().empty() && !std::filesystem::exists(created.parent_path(), ec))
+            created = created.parent_path();
+
+        if (!std::filesystem::exists(cacheDir, ec))
+            m_createdCacheDir = created;
+    }
+
+    std::filesystem::create_directories(cacheDir, ec);
+
+    if (access(cacheDir.c_str(), W_OK) != 0)
+        return false;
+
+    // Same options as the indexer
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    options.autoReloadCache = false;
+    auto kit { XDGKit::Make(options) };
+
+    for (const auto &name : themes)
+    {
+        const auto it { kit->iconThemeManager().themes().find(name) };
+
+        if (it == kit->iconThemeManager().themes().end())
+            return false;
+
+        m_cacheFiles.emplace_back(cacheDir / name);
+
+        if (!it->second->writeCache(m_cacheFiles.back()))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,225 @@
+#include "XDGTest.h"
+#include <CZ/XDG/XDGKit.h>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CZ;
+
+// XDGIconThemeManager::TrimInterval
+static constexpr uint64_t TrimInterval { 64 };
+
+static const char *trimThemes[] { "XDGTestTrimA", "XDGTestTrimB", "XDGTestTrimC" };
+
+// Three themes with the same layout, and so the same memory usage
+static void writeTrimThemes(XDGTest::Fixture &fixture) noexcept
+{
+    for (const char *theme : trimThemes)
+    {
+        fixture.theme(theme,
+            "[Icon Theme]\n"
+            "Name=Trim\n"
+            "Comment=Test trim\n"
+            "Directories=16x16/apps,32x32/apps\n\n"
+            "[16x16/apps]\nSize=16\nType=Fixed\n\n"
+            "[32x32/apps]\nSize=32\nType=Fixed\n");
+        fixture.icons(theme, "16x16/apps", { "xdgtest-trim.png" });
+        fixture.icons(theme, "32x32/apps", { "xdgtest-trim.png", "xdgtest-trim-other.png" });
+    }
+}
+
+// One search, which is also one step of the search serial
+static const XDGIcon *search(XDGIconThemeManager &manager, const char *theme) noexcept
+{
+    const std::string_view themes[] { theme };
+    return manager.findIcon("xdgtest-trim", 32, 1, XDGIcon::PNG, themes);
+}
+
+static const XDGIconTheme &trimTheme(XDGIconThemeManager &manager, size_t i) noexcept
+{
+    return *manager.themes().find(trimThemes[i])->second;
+}
+
+XDG_TEST(trimMemoryBudget)
+{
+    XDGTest::Fixture fixture;
+    writeTrimThemes(fixture);
+
+    // Searches 1 and 2 load A and B, C is searched afterwards
+    const auto searchUntil = [](XDGIconThemeManager &manager, uint64_t &serial, uint64_t target)
+    {
+        for (; serial < target; serial++)
+            XDG_CHECK(search(manager, serial == 0 ? trimThemes[0] : serial == 1 ? trimThemes[1] : trimThemes[2]));
+    };
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        options.memoryBudget = 1;
+        auto kit { XDGKit::Make(options) };
+        auto &manager { kit->iconThemeManager() };
+        uint64_t serial { 0 };
+
+        // The first check comes after TrimInterval searches, all themes were searched since startup
+        searchUntil(manager, serial, TrimInterval + 1);
+        XDG_CHECK(trimTheme(manager, 0).initialized() && trimTheme(manager, 1).initialized());
+
+        // The second one trims the themes not searched since the first one
+        searchUntil(manager, serial, 2 * TrimInterval);
+        XDG_CHECK(trimTheme(manager, 0).initialized() && trimTheme(manager, 1).initialized());
+        searchUntil(manager, serial, 2 * TrimInterval + 1);
+        XDG_CHECK(!trimTheme(manager, 0).initialized() && !trimTheme(manager, 1).initialized());
+        XDG_CHECK(trimTheme(manager, 2).initialized());
+    }
+
+    size_t usage[3];
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            search(kit->iconThemeManager(), trimThemes[i]);
+            usage[i] = trimTheme(kit->iconThemeManager(), i).memoryUsage();
+            XDG_CHECK(usage[i] > 0);
+        }
+    }
+
+    // Trimming A is enough, the least recently searched theme goes first
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    options.memoryBudget = usage[1] + usage[2] + usage[0] / 2;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+    uint64_t serial { 0 };
+    searchUntil(manager, serial, 2 * TrimInterval + 1);
+    XDG_CHECK(!trimTheme(manager, 0).initialized());
+    XDG_CHECK(trimTheme(manager, 1).initialized() && trimTheme(manager, 2).initialized());
+}
+
+XDG_TEST(trimMemoryHandles)
+{
+    XDGTest::Fixture fixture;
+    writeTrimThemes(fixture);
+
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    const XDGIcon *icon { search(manager, trimThemes[0]) };
+    const XDGIcon *kept { search(manager, trimThemes[1]) };
+    XDGIconHandle handle { manager.makeHandle(icon) };
+    XDGIconHandle keptHandle { manager.makeHandle(kept) };
+
+    // Only A is over the budget
+    manager.trimMemory(trimTheme(manager, 1).memoryUsage());
+    XDG_CHECK(!trimTheme(manager, 0).initialized() && trimTheme(manager, 1).initialized());
+    XDG_CHECK(manager.isCurrent(keptHandle) && manager.resolve(keptHandle) == kept);
+
+    // The directories of A were destroyed, the handle is resolved in the rebuilt theme
+    XDG_CHECK(!manager.isCurrent(handle));
+    icon = manager.resolve(handle);
+    XDG_CHECK(icon && icon->name() == "xdgtest-trim" && icon->directory().dirName() == "32x32/apps");
+    XDG_CHECK(icon && &icon->directory().theme() == &trimTheme(manager, 0));
+    XDG_CHECK(manager.isCurrent(handle));
+    XDG_CHECK(search(manager, trimThemes[0]) == icon);
+}
+
+XDG_TEST(trimMemoryPressure)
+{
+    XDGTest::Fixture fixture;
+    writeTrimThemes(fixture);
+
+    if (!fixture.cache({ trimThemes[0], trimThemes[1], trimThemes[2] }))
+        XDG_SKIP("the system cache directory is not writable");
+
+    XDGKit::Options options;
+    options.autoReloadCache = false;
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    // B is the oldest of the last TrimInterval searches
+    const XDGIcon *icon { search(manager, trimThemes[0]) };
+    XDG_CHECK(icon && search(manager, trimThemes[1]));
+
+    for (uint64_t i = 0; i < TrimInterval - 2; i++)
+        XDG_CHECK(search(manager, trimThemes[2]));
+
+    size_t usage[3];
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        XDG_CHECK(trimTheme(manager, i).usingCache());
+        usage[i] = trimTheme(manager, i).memoryUsage();
+    }
+
+    // Only the mapping of A is paged out
+    XDG_CHECK(search(manager, trimThemes[2]));
+    manager.dispatchMemoryPressure();
+    XDG_CHECK(trimTheme(manager, 0).memoryUsage() < usage[0]);
+    XDG_CHECK(trimTheme(manager, 1).memoryUsage() == usage[1] && trimTheme(manager, 2).memoryUsage() == usage[2]);
+
+    // Its directories and icons stay valid, pages are faulted back in when searched again
+    XDG_CHECK(trimTheme(manager, 0).initialized() && trimTheme(manager, 0).usingCache());
+    XDG_CHECK(search(manager, trimThemes[0]) == icon);
+    manager.trimMemory(std::numeric_limits<size_t>::max());
+    XDG_CHECK(trimTheme(manager, 0).memoryUsage() == usage[0]);
+}
+
+// Bytes written to stderr so far, while redirected to file
+static off_t stderrSize(FILE *file) noexcept
+{
+    fflush(stderr);
+    struct stat st;
+    return fstat(fileno(file), &st) == 0 ? st.st_size : -1;
+}
+
+XDG_TEST(trimMemoryPressureFdUnavailable)
+{
+    XDGTest::Fixture fixture;
+
+    {
+        XDGKit::Options options;
+        options.useIconThemesCache = false;
+        auto kit { XDGKit::Make(options) };
+        XDG_CHECK(kit->iconThemeManager().memoryPressureFd() == -1);
+    }
+
+    // Rejected by the kernel, same as when /proc/pressure/memory can't be opened
+    XDGKit::Options options;
+    options.useIconThemesCache = false;
+    options.monitorMemoryPressure = true;
+    options.memoryPressureTrigger = "xdgtest invalid trigger";
+    auto kit { XDGKit::Make(options) };
+    auto &manager { kit->iconThemeManager() };
+
+    FILE *log { tmpfile() };
+    XDG_CHECK(log != nullptr);
+
+    if (!log)
+        return;
+
+    fflush(stderr);
+    const int savedStderr { dup(STDERR_FILENO) };
+    dup2(fileno(log), STDERR_FILENO);
+
+    const int fd { manager.memoryPressureFd() };
+    const off_t firstLog { stderrSize(log) };
+
+    // Not retried, so nothing else is logged
+    const int retryFd { manager.memoryPressureFd() };
+    const off_t retryLog { stderrSize(log) };
+
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStderr);
+    fclose(log);
+
+    XDG_CHECK(fd == -1 && retryFd == -1);
+    XDG_CHECK(firstLog >= 0 && retryLog == firstLog);
+
+    // Trimming on demand still works
+    manager.dispatchMemoryPressure();
+}
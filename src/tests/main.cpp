@@ -0,0 +1,124 @@
+#include "XDGTest.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace CZ;
+
+static size_t failures { 0 };
+static bool skipped { false };
+static std::atomic<size_t> allocationCount { 0 };
+static std::atomic<size_t> allocationFailAt { 0 };
+
+// Replaces the global allocator of the whole process (including the library) to count allocations
+void *operator new(size_t size)
+{
+    const size_t n { allocationCount.fetch_add(1, std::memory_order_relaxed) + 1 };
+    size_t failAt { allocationFailAt.load(std::memory_order_relaxed) };
+
+    if (failAt != 0 && n >= failAt && allocationFailAt.compare_exchange_strong(failAt, 0))
+        throw std::bad_alloc();
+
+    if (void *ptr = malloc(size ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// Also used by the standard library (e.g. std::stable_sort()), its memory is released with the operator delete below
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    try { return operator new(size); }
+    catch (const std::bad_alloc &) { return nullptr; }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+size_t XDGTest::allocations() noexcept
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+void XDGTest::failAllocation(size_t n) noexcept
+{
+    allocationFailAt.store(n == 0 ? 0 : allocations() + n, std::memory_order_relaxed);
+}
+
+std::vector<XDGTest::Case> &XDGTest::cases() noexcept
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+void XDGTest::fail(const char *file, int line, const char *expr) noexcept
+{
+    failures++;
+    fprintf(stderr, "    %s:%d: check failed: %s\n", file, line, expr);
+}
+
+void XDGTest::skip(const char *reason) noexcept
+{
+    skipped = true;
+    printf("    skipped: %s\n", reason);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filter { argc > 1 ? argv[1] : nullptr };
+    size_t failed { 0 }, run { 0 };
+
+    for (const auto &test : XDGTest::cases())
+    {
+        if (filter && !strstr(test.name, filter))
+            continue;
+
+        printf("%s\n", test.name);
+        fflush(stdout);
+
+        const size_t before { failures };
+        skipped = false;
+        test.run();
+        run++;
+
+        if (failures != before)
+        {
+            failed++;
+            printf("    FAILED\n");
+        }
+        else if (!skipped)
+            printf("    OK\n");
+    }
+
+    printf("\n%zu of %zu tests failed\n", failed, run);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}